@@ -0,0 +1,245 @@
+#include "analytics.h"
+
+/*
+ * Borrow and return feed fixed-size aggregators as they happen, so the
+ * statistics never scan loan history. Popular titles and authors use the
+ * Space-Saving algorithm: TOP_K_SLOTS counters, and an unseen key takes
+ * over the smallest counter and inherits its count as its error bound.
+ * Any key borrowed more often than total / TOP_K_SLOTS times is
+ * guaranteed a slot. Daily volumes are kept in a ring of HISTORY_DAYS
+ * buckets indexed by local calendar day; a bucket is reset when a newer
+ * day reuses it. The aggregators are saved with the catalog (CIRC, TOP
+ * and DAY lines, or the snapshot metadata block), so they cover the whole
+ * life of the data file rather than one run.
+ */
+
+/* Day number of the local calendar date, 0 = 1970-01-01 */
+static long local_day(time_t when) {
+  struct tm tm_info;
+  localtime_r(&when, &tm_info);
+
+  long year = tm_info.tm_year + 1900L;
+  long month = tm_info.tm_mon + 1;
+  year -= month <= 2;
+  long era = (year >= 0 ? year : year - 399) / 400;
+  long year_of_era = year - era * 400;
+  long day_of_year =
+      (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + tm_info.tm_mday - 1;
+  long day_of_era =
+      year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  return era * 146097 + day_of_era - 719468;
+}
+
+void clear_circulation(CirculationStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (int i = 0; i < HISTORY_DAYS; i++) {
+    stats->days[i] = -1;
+  }
+}
+
+static void observe(TopKEntry *slots, int *count, const char *key) {
+  int smallest = 0;
+  for (int i = 0; i < *count; i++) {
+    if (strcmp(slots[i].key, key) == 0) {
+      slots[i].count++;
+      return;
+    }
+    if (slots[i].count < slots[smallest].count) {
+      smallest = i;
+    }
+  }
+
+  TopKEntry *slot;
+  if (*count < TOP_K_SLOTS) {
+    slot = &slots[(*count)++];
+    slot->count = 0;
+  } else {
+    slot = &slots[smallest];
+  }
+  strncpy(slot->key, key, MAX_TITLE_LENGTH - 1);
+  slot->key[MAX_TITLE_LENGTH - 1] = '\0';
+  slot->error = slot->count;
+  slot->count++;
+}
+
+static int ring_slot(long day) {
+  return (int)(((day % HISTORY_DAYS) + HISTORY_DAYS) % HISTORY_DAYS);
+}
+
+static int day_slot(CirculationStats *stats, time_t when) {
+  long day = local_day(when);
+  int slot = ring_slot(day);
+  if (stats->days[slot] != day) {
+    if (stats->days[slot] > day) {
+      return -1; /* older than the ring reaches */
+    }
+    stats->days[slot] = day;
+    stats->checkouts[slot] = 0;
+    stats->returns[slot] = 0;
+  }
+  return slot;
+}
+
+void record_checkout(CirculationStats *stats, const Book *book, time_t when) {
+  observe(stats->titles, &stats->title_count, book->title);
+  observe(stats->authors, &stats->author_count, book->author);
+  stats->total_checkouts++;
+
+  int slot = day_slot(stats, when);
+  if (slot >= 0) {
+    stats->checkouts[slot]++;
+  }
+}
+
+void record_return(CirculationStats *stats, time_t when) {
+  int slot = day_slot(stats, when);
+  if (slot >= 0) {
+    stats->returns[slot]++;
+  }
+}
+
+/* Persistence */
+
+static void write_top_records(FILE *file, char kind, const TopKEntry *slots,
+                              int count) {
+  for (int i = 0; i < count; i++) {
+    fprintf(file, "TOP|%c|%lu|%lu|%s\n", kind, slots[i].count, slots[i].error,
+            slots[i].key);
+  }
+}
+
+void write_circulation_records(FILE *file, const CirculationStats *stats) {
+  fprintf(file, "CIRC|%lu\n", stats->total_checkouts);
+  write_top_records(file, 't', stats->titles, stats->title_count);
+  write_top_records(file, 'a', stats->authors, stats->author_count);
+  for (int i = 0; i < HISTORY_DAYS; i++) {
+    if (stats->days[i] >= 0) {
+      fprintf(file, "DAY|%ld|%u|%u\n", stats->days[i], stats->checkouts[i],
+              stats->returns[i]);
+    }
+  }
+}
+
+/* True when the line was a circulation record */
+bool parse_circulation_record(CirculationStats *stats, const char *line) {
+  unsigned long count, error;
+  unsigned int checkouts, returns;
+  long day;
+  char kind;
+  int key_start = 0;
+
+  if (sscanf(line, "CIRC|%lu", &count) == 1) {
+    stats->total_checkouts = count;
+    return true;
+  }
+
+  /* The key runs to the end of the line and may contain '|' */
+  if (sscanf(line, "TOP|%c|%lu|%lu|%n", &kind, &count, &error, &key_start) ==
+          3 &&
+      key_start > 0) {
+    TopKEntry *slots = kind == 't' ? stats->titles : stats->authors;
+    int *slot_count = kind == 't' ? &stats->title_count : &stats->author_count;
+    if ((kind == 't' || kind == 'a') && *slot_count < TOP_K_SLOTS) {
+      TopKEntry *slot = &slots[(*slot_count)++];
+      strncpy(slot->key, line + key_start, MAX_TITLE_LENGTH - 1);
+      slot->key[MAX_TITLE_LENGTH - 1] = '\0';
+      slot->count = count;
+      slot->error = error;
+    }
+    return true;
+  }
+
+  if (sscanf(line, "DAY|%ld|%u|%u", &day, &checkouts, &returns) == 3) {
+    if (day >= 0) {
+      int slot = ring_slot(day);
+      stats->days[slot] = day;
+      stats->checkouts[slot] = checkouts;
+      stats->returns[slot] = returns;
+    }
+    return true;
+  }
+  return false;
+}
+
+/* Queries */
+
+static int top_entries(const TopKEntry *slots, int count, TopKEntry *out,
+                       int k) {
+  if (k > count) {
+    k = count;
+  }
+
+  /* Partial selection sort: k <= TOP_K_SLOTS */
+  bool taken[TOP_K_SLOTS] = {false};
+  for (int n = 0; n < k; n++) {
+    int best = -1;
+    for (int i = 0; i < count; i++) {
+      if (!taken[i] && (best < 0 || slots[i].count > slots[best].count)) {
+        best = i;
+      }
+    }
+    taken[best] = true;
+    out[n] = slots[best];
+  }
+  return k;
+}
+
+int top_titles(const CirculationStats *stats, TopKEntry *out, int k) {
+  return top_entries(stats->titles, stats->title_count, out, k);
+}
+
+int top_authors(const CirculationStats *stats, TopKEntry *out, int k) {
+  return top_entries(stats->authors, stats->author_count, out, k);
+}
+
+void daily_activity(const CirculationStats *stats, time_t day, int *checkouts,
+                    int *returns) {
+  long number = local_day(day);
+  int slot = ring_slot(number);
+  bool present = stats->days[slot] == number;
+  *checkouts = present ? (int)stats->checkouts[slot] : 0;
+  *returns = present ? (int)stats->returns[slot] : 0;
+}
+
+void display_circulation(const CirculationStats *stats) {
+  TopKEntry top[5];
+  int count;
+
+  printf("\nCirculation: %lu checkouts\n", stats->total_checkouts);
+
+  count = top_titles(stats, top, 5);
+  if (count > 0) {
+    printf("  Most borrowed titles:\n");
+    for (int i = 0; i < count; i++) {
+      printf("    %d. %s (%lu)\n", i + 1, top[i].key, top[i].count);
+    }
+  }
+
+  count = top_authors(stats, top, 5);
+  if (count > 0) {
+    printf("  Most borrowed authors:\n");
+    for (int i = 0; i < count; i++) {
+      printf("    %d. %s (%lu)\n", i + 1, top[i].key, top[i].count);
+    }
+  }
+
+  printf("  Last 7 days (checkouts / returns):\n");
+  time_t now = time(NULL);
+  for (int i = 6; i >= 0; i--) {
+    /* Step back from noon so DST changes cannot skip a date */
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
+    tm_info.tm_mday -= i;
+    tm_info.tm_hour = 12;
+    tm_info.tm_min = 0;
+    tm_info.tm_sec = 0;
+    tm_info.tm_isdst = -1;
+    time_t day = mktime(&tm_info);
+
+    char date[DATE_LENGTH];
+    int checkouts, returns;
+    strftime(date, sizeof(date), "%Y-%m-%d", &tm_info);
+    daily_activity(stats, day, &checkouts, &returns);
+    printf("    %s  %3d / %3d\n", date, checkouts, returns);
+  }
+}
@@ -0,0 +1,22 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include "../Utils/utils.h"
+
+/* Circulation Tracking */
+void clear_circulation(CirculationStats *stats);
+void record_checkout(CirculationStats *stats, const Book *book, time_t when);
+void record_return(CirculationStats *stats, time_t when);
+
+/* Persistence */
+void write_circulation_records(FILE *file, const CirculationStats *stats);
+bool parse_circulation_record(CirculationStats *stats, const char *line);
+
+/* Queries */
+int top_titles(const CirculationStats *stats, TopKEntry *out, int k);
+int top_authors(const CirculationStats *stats, TopKEntry *out, int k);
+void daily_activity(const CirculationStats *stats, time_t day, int *checkouts,
+                    int *returns);
+void display_circulation(const CirculationStats *stats);
+
+#endif /* ANALYTICS_H */
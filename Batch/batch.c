@@ -0,0 +1,176 @@
+#include "batch.h"
+#include "../Trace/trace.h"
+
+/*
+ * A batch is applied to a private copy of the library with the ordinary
+ * operations, so later operations see the effects of earlier ones (return
+ * a book, then lend it to the next patron). Only if every operation
+ * succeeds is the copy written back, carrying its dirty bits and new
+ * generation with it; otherwise the library is left untouched. Callers
+ * then lock, invalidate and save once per batch instead of once per item;
+ * on a branch, a batch whose save fails is rolled back as well.
+ */
+
+void init_batch(OperationBatch *batch) { batch->count = 0; }
+
+static BatchOperation *next_operation(OperationBatch *batch,
+                                      OperationType type) {
+  if (batch->count >= MAX_BATCH_OPERATIONS) {
+    return NULL;
+  }
+  BatchOperation *op = &batch->operations[batch->count++];
+  memset(op, 0, sizeof(*op));
+  op->type = type;
+  return op;
+}
+
+static void copy_book_fields(BatchOperation *op, const char *title,
+                             const char *author, const char *genre) {
+  strncpy(op->title, title, MAX_TITLE_LENGTH - 1);
+  strncpy(op->author, author, MAX_AUTHOR_LENGTH - 1);
+  strncpy(op->genre, genre, MAX_GENRE_LENGTH - 1);
+}
+
+ErrorCode batch_borrow(OperationBatch *batch, int user_id, int book_id) {
+  BatchOperation *op = next_operation(batch, OP_BORROW);
+  if (op == NULL) {
+    return ERROR_INVALID_INPUT;
+  }
+  op->user_id = user_id;
+  op->book_id = book_id;
+  return SUCCESS;
+}
+
+ErrorCode batch_return(OperationBatch *batch, int user_id, int book_id) {
+  BatchOperation *op = next_operation(batch, OP_RETURN);
+  if (op == NULL) {
+    return ERROR_INVALID_INPUT;
+  }
+  op->user_id = user_id;
+  op->book_id = book_id;
+  return SUCCESS;
+}
+
+ErrorCode batch_add_book(OperationBatch *batch, const char *title,
+                         const char *author, const char *genre) {
+  if (!is_valid_string(title) || !is_valid_string(author) ||
+      !is_valid_string(genre)) {
+    return ERROR_INVALID_INPUT;
+  }
+  BatchOperation *op = next_operation(batch, OP_ADD_BOOK);
+  if (op == NULL) {
+    return ERROR_INVALID_INPUT;
+  }
+  copy_book_fields(op, title, author, genre);
+  return SUCCESS;
+}
+
+ErrorCode batch_update_book(OperationBatch *batch, int book_id,
+                            const char *title, const char *author,
+                            const char *genre) {
+  if (!is_valid_string(title) || !is_valid_string(author) ||
+      !is_valid_string(genre)) {
+    return ERROR_INVALID_INPUT;
+  }
+  BatchOperation *op = next_operation(batch, OP_UPDATE_BOOK);
+  if (op == NULL) {
+    return ERROR_INVALID_INPUT;
+  }
+  op->book_id = book_id;
+  copy_book_fields(op, title, author, genre);
+  return SUCCESS;
+}
+
+static ErrorCode apply_operation(Library *lib, const BatchOperation *op,
+                                 time_t when) {
+  switch (op->type) {
+  case OP_BORROW:
+    return borrow_book_at(lib, op->user_id, op->book_id, when);
+  case OP_RETURN:
+    return return_book_at(lib, op->user_id, op->book_id, when);
+  case OP_ADD_BOOK:
+    return add_book(lib, op->title, op->author, op->genre);
+  case OP_UPDATE_BOOK:
+    return update_book(lib, op->book_id, op->title, op->author, op->genre);
+  default:
+    return ERROR_INVALID_INPUT;
+  }
+}
+
+static void trace_operation(const BatchOperation *op, time_t when) {
+  switch (op->type) {
+  case OP_BORROW:
+    trace_loan(TRACE_BORROW, op->user_id, op->book_id, when);
+    break;
+  case OP_RETURN:
+    trace_loan(TRACE_RETURN, op->user_id, op->book_id, when);
+    break;
+  case OP_ADD_BOOK:
+    trace_add_book(op->title, op->author, op->genre);
+    break;
+  case OP_UPDATE_BOOK:
+    trace_update_book(op->book_id, op->title, op->author, op->genre);
+    break;
+  }
+}
+
+ErrorCode commit_batch(Library *lib, const OperationBatch *batch,
+                       int *failed_index) {
+  if (failed_index != NULL) {
+    *failed_index = -1;
+  }
+
+  Library *scratch = malloc(sizeof(Library));
+  if (scratch == NULL) {
+    return ERROR_FILE_IO;
+  }
+  *scratch = *lib;
+  time_t when = time(NULL);
+
+  /* Traced only once it commits, then as the calls it is made of */
+  trace_suppress();
+  for (int i = 0; i < batch->count; i++) {
+    ErrorCode result = apply_operation(scratch, &batch->operations[i], when);
+    if (result != SUCCESS) {
+      trace_resume();
+      if (failed_index != NULL) {
+        *failed_index = i;
+      }
+      free(scratch);
+      return result;
+    }
+  }
+  trace_resume();
+  for (int i = 0; i < batch->count; i++) {
+    trace_operation(&batch->operations[i], when);
+  }
+
+  *lib = *scratch;
+  free(scratch);
+  return SUCCESS;
+}
+
+/* A batch the data file does not hold is undone, so memory matches disk */
+ErrorCode commit_branch_batch(Branch *branch, const OperationBatch *batch,
+                              int *failed_index) {
+  Library *before = malloc(sizeof(Library));
+  if (before == NULL) {
+    if (failed_index != NULL) {
+      *failed_index = -1;
+    }
+    return ERROR_FILE_IO;
+  }
+
+  pthread_mutex_lock(&branch->lock);
+  *before = *branch->lib;
+  ErrorCode result = commit_batch(branch->lib, batch, failed_index);
+  if (result == SUCCESS) {
+    result = save_library_to_file(branch->lib, branch->filename);
+    if (result != SUCCESS) {
+      *branch->lib = *before;
+    }
+  }
+  pthread_mutex_unlock(&branch->lock);
+  free(before);
+  return result;
+}
@@ -0,0 +1,44 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "../Branch/branch.h"
+#include "../Management/management.h"
+#include "../Utils/utils.h"
+
+/* Batch Constants */
+#define MAX_BATCH_OPERATIONS 32
+
+/* Type Definitions */
+typedef enum { OP_BORROW, OP_RETURN, OP_ADD_BOOK, OP_UPDATE_BOOK } OperationType;
+
+typedef struct {
+  OperationType type;
+  int user_id;
+  int book_id;
+  char title[MAX_TITLE_LENGTH];
+  char author[MAX_AUTHOR_LENGTH];
+  char genre[MAX_GENRE_LENGTH];
+} BatchOperation;
+
+typedef struct {
+  BatchOperation operations[MAX_BATCH_OPERATIONS];
+  int count;
+} OperationBatch;
+
+/* Batch Building Functions */
+void init_batch(OperationBatch *batch);
+ErrorCode batch_borrow(OperationBatch *batch, int user_id, int book_id);
+ErrorCode batch_return(OperationBatch *batch, int user_id, int book_id);
+ErrorCode batch_add_book(OperationBatch *batch, const char *title,
+                         const char *author, const char *genre);
+ErrorCode batch_update_book(OperationBatch *batch, int book_id,
+                            const char *title, const char *author,
+                            const char *genre);
+
+/* Batch Commit Functions */
+ErrorCode commit_batch(Library *lib, const OperationBatch *batch,
+                       int *failed_index);
+ErrorCode commit_branch_batch(Branch *branch, const OperationBatch *batch,
+                              int *failed_index);
+
+#endif /* BATCH_H */
@@ -1,9 +1,12 @@
 #include "book.h"
+#include "../Parallel/parallel.h"
+#include "../Trace/trace.h"
 
 /* Book Management Functions */
 
 ErrorCode add_book(Library *lib, const char *title, const char *author,
                    const char *genre) {
+  trace_add_book(title, author, genre);
   if (!is_valid_string(title) || !is_valid_string(author) ||
       !is_valid_string(genre)) {
     return ERROR_INVALID_INPUT;
@@ -23,13 +26,17 @@ ErrorCode add_book(Library *lib, const char *title, const char *author,
   new_book->genre[MAX_GENRE_LENGTH - 1] = '\0';
   new_book->status = BOOK_AVAILABLE;
   new_book->borrower_id = NO_BORROWER;
+  new_book->hold_head = NO_HOLD;
+  new_book->hold_tail = NO_HOLD;
 
+  mark_book_dirty(lib, lib->book_count);
   lib->book_count++;
   return SUCCESS;
 }
 
 ErrorCode update_book(Library *lib, int book_id, const char *title,
                       const char *author, const char *genre) {
+  trace_update_book(book_id, title, author, genre);
   if (!is_valid_string(title) || !is_valid_string(author) ||
       !is_valid_string(genre)) {
     return ERROR_INVALID_INPUT;
@@ -47,10 +54,12 @@ ErrorCode update_book(Library *lib, int book_id, const char *title,
   strncpy(book->genre, genre, MAX_GENRE_LENGTH - 1);
   book->genre[MAX_GENRE_LENGTH - 1] = '\0';
 
+  mark_book_dirty(lib, (int)(book - lib->books));
   return SUCCESS;
 }
 
 ErrorCode delete_book(Library *lib, int book_id) {
+  trace_delete_book(book_id);
   int index = -1;
   for (int i = 0; i < lib->book_count; i++) {
     if (lib->books[i].id == book_id) {
@@ -70,11 +79,35 @@ ErrorCode delete_book(Library *lib, int book_id) {
   for (int i = index; i < lib->book_count - 1; i++) {
     lib->books[i] = lib->books[i + 1];
   }
+  mark_books_dirty(lib, index, lib->book_count);
   lib->book_count--;
 
   return SUCCESS;
 }
 
+/* Adds a book keeping its ID, e.g. when it moves in from another branch */
+ErrorCode import_book(Library *lib, const Book *book) {
+  if (!is_valid_string(book->title) || book->id <= 0) {
+    return ERROR_INVALID_INPUT;
+  }
+
+  if (lib->book_count >= MAX_BOOKS) {
+    return ERROR_MAX_BOOKS_REACHED;
+  }
+
+  if (find_book_by_id(lib, book->id) != NULL) {
+    return ERROR_INVALID_INPUT;
+  }
+
+  /* Queue indices point into the source library's pool */
+  lib->books[lib->book_count] = *book;
+  lib->books[lib->book_count].hold_head = NO_HOLD;
+  lib->books[lib->book_count].hold_tail = NO_HOLD;
+  mark_book_dirty(lib, lib->book_count);
+  lib->book_count++;
+  return SUCCESS;
+}
+
 Book *find_book_by_id(Library *lib, int book_id) {
   for (int i = 0; i < lib->book_count; i++) {
     if (lib->books[i].id == book_id) {
@@ -86,74 +119,74 @@ Book *find_book_by_id(Library *lib, int book_id) {
 
 /* Book Search Functions */
 
-void search_books_by_title(Library *lib, const char *title) {
-  if (!is_valid_string(title)) {
-    printf("Invalid search term!\n");
-    return;
+const char *get_book_field(const Book *book, SearchField field) {
+  switch (field) {
+  case SEARCH_BY_AUTHOR:
+    return book->author;
+  case SEARCH_BY_GENRE:
+    return book->genre;
+  default:
+    return book->title;
   }
+}
 
-  printf("\n=== Search by Title: '%s' ===\n", title);
-  bool found = false;
-
-  for (int i = 0; i < lib->book_count; i++) {
-    if (stristr(lib->books[i].title, title) != NULL) {
-      printf("ID: %d | Title: %s | Author: %s | Genre: %s | Status: %s\n",
-             lib->books[i].id, lib->books[i].title, lib->books[i].author,
-             lib->books[i].genre,
-             lib->books[i].status == BOOK_AVAILABLE ? "Available" : "Borrowed");
-      found = true;
-    }
-  }
+typedef struct {
+  const Library *lib;
+  SearchField field;
+  const char *term;
+} SearchContext;
 
-  if (!found) {
-    printf("No books found!\n");
-  }
+static bool book_matches(int index, void *context) {
+  const SearchContext *search = context;
+  return stristr(get_book_field(&search->lib->books[index], search->field),
+                 search->term) != NULL;
 }
 
-void search_books_by_author(Library *lib, const char *author) {
-  if (!is_valid_string(author)) {
-    printf("Invalid search term!\n");
-    return;
+void report_book_search(Library *lib, SearchField field, const char *term,
+                        RowWriter *out) {
+  trace_search(field, term);
+  int matches[MAX_BOOKS];
+  int count = query_cache_lookup(lib, field, term, matches);
+  if (count < 0) {
+    SearchContext search = {lib, field, term};
+    count = parallel_scan(lib->book_count, book_matches, &search, matches);
+    query_cache_store(lib, field, term, matches, count);
   }
 
-  printf("\n=== Search by Author: '%s' ===\n", author);
-  bool found = false;
-
-  for (int i = 0; i < lib->book_count; i++) {
-    if (stristr(lib->books[i].author, author) != NULL) {
-      printf("ID: %d | Title: %s | Author: %s | Genre: %s | Status: %s\n",
-             lib->books[i].id, lib->books[i].title, lib->books[i].author,
-             lib->books[i].genre,
-             lib->books[i].status == BOOK_AVAILABLE ? "Available" : "Borrowed");
-      found = true;
-    }
+  for (int i = 0; i < count; i++) {
+    row_write_book(out, &lib->books[matches[i]], true);
   }
 
-  if (!found) {
-    printf("No books found!\n");
+  if (count == 0) {
+    row_writer_message(out, "No books found!");
   }
 }
 
-void search_books_by_genre(Library *lib, const char *genre) {
-  if (!is_valid_string(genre)) {
+static void search_books(Library *lib, SearchField field, const char *term,
+                         const char *label) {
+  if (!is_valid_string(term)) {
     printf("Invalid search term!\n");
     return;
   }
 
-  printf("\n=== Search by Genre: '%s' ===\n", genre);
-  bool found = false;
+  char heading[MAX_TITLE_LENGTH + 32];
+  snprintf(heading, sizeof(heading), "Search by %s: '%s'", label, term);
 
-  for (int i = 0; i < lib->book_count; i++) {
-    if (stristr(lib->books[i].genre, genre) != NULL) {
-      printf("ID: %d | Title: %s | Author: %s | Genre: %s | Status: %s\n",
-             lib->books[i].id, lib->books[i].title, lib->books[i].author,
-             lib->books[i].genre,
-             lib->books[i].status == BOOK_AVAILABLE ? "Available" : "Borrowed");
-      found = true;
-    }
-  }
+  RowWriter out;
+  row_writer_init_stream(&out, stdout, OUTPUT_TABLE);
+  row_writer_title(&out, heading);
+  report_book_search(lib, field, term, &out);
+  row_writer_finish(&out);
+}
 
-  if (!found) {
-    printf("No books found!\n");
-  }
+void search_books_by_title(Library *lib, const char *title) {
+  search_books(lib, SEARCH_BY_TITLE, title, "Title");
+}
+
+void search_books_by_author(Library *lib, const char *author) {
+  search_books(lib, SEARCH_BY_AUTHOR, author, "Author");
+}
+
+void search_books_by_genre(Library *lib, const char *genre) {
+  search_books(lib, SEARCH_BY_GENRE, genre, "Genre");
 }
@@ -1,6 +1,8 @@
 #ifndef BOOK_H
 #define BOOK_H
 
+#include "../Cache/cache.h"
+#include "../Output/output.h"
 #include "../Utils/utils.h"
 
 /* Book Management Functions */
@@ -9,11 +11,15 @@ ErrorCode add_book(Library *lib, const char *title, const char *author,
 ErrorCode update_book(Library *lib, int book_id, const char *title,
                       const char *author, const char *genre);
 ErrorCode delete_book(Library *lib, int book_id);
+ErrorCode import_book(Library *lib, const Book *book);
 Book *find_book_by_id(Library *lib, int book_id);
 
 /* Book Search Functions */
 void search_books_by_title(Library *lib, const char *title);
 void search_books_by_author(Library *lib, const char *author);
 void search_books_by_genre(Library *lib, const char *genre);
+const char *get_book_field(const Book *book, SearchField field);
+void report_book_search(Library *lib, SearchField field, const char *term,
+                        RowWriter *out);
 
 #endif /* BOOK_H */
@@ -0,0 +1,436 @@
+#include "branch.h"
+#include "../Parallel/parallel.h"
+
+/*
+ * One process hosts several branch libraries, each with its own data file
+ * and lock. Every branch is opened with a fixed number and hands out book
+ * and user IDs from its own range (branch n starts at n * BRANCH_ID_SPAN +
+ * 1), so IDs stay unique across the network however the branches are
+ * opened, and a book transferred elsewhere keeps its ID. Searches and
+ * statistics fan out to every branch on the worker pool and are merged in
+ * branch order.
+ */
+
+void init_branch_network(BranchNetwork *net, const char *journal) {
+  net->branch_count = 0;
+  strncpy(net->journal, journal, MAX_PATH_LENGTH - 1);
+  net->journal[MAX_PATH_LENGTH - 1] = '\0';
+}
+
+void free_branch_network(BranchNetwork *net) {
+  for (int i = 0; i < net->branch_count; i++) {
+    pthread_mutex_destroy(&net->branches[i].lock);
+    free(net->branches[i].lib);
+  }
+  net->branch_count = 0;
+}
+
+static Branch *find_branch_by_number(BranchNetwork *net, int number) {
+  for (int i = 0; i < net->branch_count; i++) {
+    if (net->branches[i].number == number) {
+      return &net->branches[i];
+    }
+  }
+  return NULL;
+}
+
+ErrorCode add_branch(BranchNetwork *net, const char *name, int number,
+                     const char *filename) {
+  if (!is_valid_string(name) || !is_valid_string(filename) || number < 0 ||
+      number >= MAX_BRANCHES) {
+    return ERROR_INVALID_INPUT;
+  }
+  if (net->branch_count >= MAX_BRANCHES || find_branch(net, name) != NULL ||
+      find_branch_by_number(net, number) != NULL) {
+    return ERROR_INVALID_INPUT;
+  }
+
+  Library *lib = malloc(sizeof(Library));
+  if (lib == NULL) {
+    return ERROR_FILE_IO;
+  }
+  init_library(lib);
+  ErrorCode result = load_library_from_file(lib, filename);
+  if (result != SUCCESS) {
+    free(lib);
+    return result;
+  }
+
+  /* A file that issued IDs past this range belongs to another number */
+  int base = number * BRANCH_ID_SPAN;
+  if (lib->next_book_id > base + BRANCH_ID_SPAN + 1 ||
+      lib->next_user_id > base + BRANCH_ID_SPAN + 1) {
+    free(lib);
+    return ERROR_INVALID_INPUT;
+  }
+  if (lib->next_book_id <= base) {
+    lib->next_book_id = base + 1;
+  }
+  if (lib->next_user_id <= base) {
+    lib->next_user_id = base + 1;
+  }
+
+  Branch *branch = &net->branches[net->branch_count];
+  strncpy(branch->name, name, MAX_NAME_LENGTH - 1);
+  branch->name[MAX_NAME_LENGTH - 1] = '\0';
+  branch->number = number;
+  strncpy(branch->filename, filename, MAX_PATH_LENGTH - 1);
+  branch->filename[MAX_PATH_LENGTH - 1] = '\0';
+  branch->lib = lib;
+  pthread_mutex_init(&branch->lock, NULL);
+
+  net->branch_count++;
+  return SUCCESS;
+}
+
+Branch *find_branch(BranchNetwork *net, const char *name) {
+  for (int i = 0; i < net->branch_count; i++) {
+    if (strcmp(net->branches[i].name, name) == 0) {
+      return &net->branches[i];
+    }
+  }
+  return NULL;
+}
+
+static bool branch_has_book(Branch *branch, int book_id) {
+  pthread_mutex_lock(&branch->lock);
+  bool found = find_book_by_id(branch->lib, book_id) != NULL;
+  pthread_mutex_unlock(&branch->lock);
+  return found;
+}
+
+/* The ID range names the home branch; transferred books need a search */
+Branch *find_branch_for_book(BranchNetwork *net, int book_id) {
+  Branch *home = find_branch_by_number(net, (book_id - 1) / BRANCH_ID_SPAN);
+  if (home != NULL && branch_has_book(home, book_id)) {
+    return home;
+  }
+
+  for (int i = 0; i < net->branch_count; i++) {
+    if (&net->branches[i] != home &&
+        branch_has_book(&net->branches[i], book_id)) {
+      return &net->branches[i];
+    }
+  }
+  return NULL;
+}
+
+static ErrorCode save_branch_locked(Branch *branch) {
+  return save_library_to_file(branch->lib, branch->filename);
+}
+
+ErrorCode save_branch(Branch *branch) {
+  pthread_mutex_lock(&branch->lock);
+  ErrorCode result = save_branch_locked(branch);
+  pthread_mutex_unlock(&branch->lock);
+  return result;
+}
+
+ErrorCode save_all_branches(BranchNetwork *net) {
+  ErrorCode result = SUCCESS;
+  for (int i = 0; i < net->branch_count; i++) {
+    if (save_branch(&net->branches[i]) != SUCCESS) {
+      result = ERROR_FILE_IO;
+    }
+  }
+  return result;
+}
+
+/*
+ * A transfer changes two data files, which cannot be replaced together.
+ * Before either is saved the intent ("TRANSFER <id>", then the source and
+ * destination names, one per line) is written to the network's journal;
+ * the destination is saved first, then the source, and the journal is
+ * removed. A crash in between leaves the book in both files, and
+ * recover_branch_transfer() finishes the move on the next start. With the
+ * book in only one branch the files already agree, so a leftover journal
+ * is stale and is simply dropped.
+ */
+
+static void lock_pair(Branch *a, Branch *b) {
+  /* In network order, so concurrent transfers cannot deadlock */
+  Branch *first = a < b ? a : b;
+  Branch *second = a < b ? b : a;
+  pthread_mutex_lock(&first->lock);
+  pthread_mutex_lock(&second->lock);
+}
+
+static void unlock_pair(Branch *a, Branch *b) {
+  pthread_mutex_unlock(&a->lock);
+  pthread_mutex_unlock(&b->lock);
+}
+
+static ErrorCode write_transfer_intent(BranchNetwork *net, const Branch *from,
+                                       const Branch *to, int book_id) {
+  AtomicFile file;
+  FILE *stream = atomic_file_begin(&file, net->journal);
+  if (stream == NULL) {
+    return ERROR_FILE_IO;
+  }
+  fprintf(stream, "TRANSFER %d\n%s\n%s\n", book_id, from->name, to->name);
+  return atomic_file_commit(&file, NULL);
+}
+
+static void clear_transfer_intent(BranchNetwork *net) { remove(net->journal); }
+
+/* Puts the book back where it came from; the caller holds both locks */
+static void undo_move(Branch *from, Branch *to, const Book *moved) {
+  delete_book(to->lib, moved->id);
+  import_book(from->lib, moved);
+}
+
+static ErrorCode move_book(BranchNetwork *net, Branch *from, Branch *to,
+                           const Book *book) {
+  Book moved = *book;
+  ErrorCode result = import_book(to->lib, &moved);
+  if (result != SUCCESS) {
+    return result;
+  }
+  delete_book(from->lib, moved.id);
+
+  if (write_transfer_intent(net, from, to, moved.id) != SUCCESS) {
+    undo_move(from, to, &moved);
+    return ERROR_FILE_IO;
+  }
+  if (save_branch_locked(to) != SUCCESS) {
+    /* Neither file changed */
+    undo_move(from, to, &moved);
+    clear_transfer_intent(net);
+    return ERROR_FILE_IO;
+  }
+  if (save_branch_locked(from) != SUCCESS) {
+    /* The journal stays until the destination's copy is gone again */
+    undo_move(from, to, &moved);
+    if (save_branch_locked(to) == SUCCESS) {
+      clear_transfer_intent(net);
+    }
+    return ERROR_FILE_IO;
+  }
+  clear_transfer_intent(net);
+  return SUCCESS;
+}
+
+/*
+ * Both branches stay locked while the book is checked, moved and saved, so
+ * nobody observes it in both or neither. Books with patrons waiting are
+ * refused: the queue holds the source branch's users, who cannot borrow
+ * from the destination.
+ */
+ErrorCode transfer_book(BranchNetwork *net, Branch *from, Branch *to,
+                        int book_id) {
+  Branch *end = net->branches + net->branch_count;
+  if (from == NULL || to == NULL || from == to || from < net->branches ||
+      from >= end || to < net->branches || to >= end) {
+    return ERROR_INVALID_INPUT;
+  }
+
+  lock_pair(from, to);
+  ErrorCode result;
+  Book *book = find_book_by_id(from->lib, book_id);
+  if (book == NULL) {
+    result = ERROR_BOOK_NOT_FOUND;
+  } else if (book->status == BOOK_BORROWED) {
+    result = ERROR_BOOK_ALREADY_BORROWED;
+  } else if (book->hold_head != NO_HOLD) {
+    result = ERROR_BOOK_HAS_HOLDS;
+  } else {
+    result = move_book(net, from, to, book);
+  }
+  unlock_pair(from, to);
+  return result;
+}
+
+/* Call once every branch has been added */
+ErrorCode recover_branch_transfer(BranchNetwork *net) {
+  FILE *probe = fopen(net->journal, "r");
+  if (probe == NULL) {
+    return SUCCESS; /* no transfer was in progress */
+  }
+  fclose(probe);
+
+  char *data;
+  ErrorCode result = read_checked_file(net->journal, true, &data, NULL, NULL);
+  if (result != SUCCESS) {
+    return result;
+  }
+  char *cursor = data;
+  char *line = next_line(&cursor);
+  int book_id;
+  bool valid = line != NULL && sscanf(line, "TRANSFER %d", &book_id) == 1;
+  char *from_name = valid ? next_line(&cursor) : NULL;
+  char *to_name = from_name != NULL ? next_line(&cursor) : NULL;
+  Branch *from = from_name != NULL ? find_branch(net, from_name) : NULL;
+  Branch *to = to_name != NULL ? find_branch(net, to_name) : NULL;
+  free(data);
+  if (from == NULL || to == NULL || from == to) {
+    return ERROR_INVALID_INPUT; /* not the network the journal belongs to */
+  }
+
+  lock_pair(from, to);
+  if (find_book_by_id(from->lib, book_id) != NULL &&
+      find_book_by_id(to->lib, book_id) != NULL) {
+    /* Crashed between the two saves: drop the source's copy */
+    result = delete_book(from->lib, book_id);
+    if (result == SUCCESS) {
+      result = save_branch_locked(from);
+    }
+  }
+  unlock_pair(from, to);
+
+  if (result == SUCCESS) {
+    clear_transfer_intent(net);
+  }
+  return result;
+}
+
+/* Fan-out Search */
+
+typedef struct {
+  Branch *branch;
+  SearchField field;
+  const char *term;
+  Book hits[MAX_BOOKS];
+  int count;
+} BranchScan;
+
+static void scan_branch(void *arg) {
+  BranchScan *scan = arg;
+  Library *lib = scan->branch->lib;
+
+  pthread_mutex_lock(&scan->branch->lock);
+  scan->count = 0;
+  for (int i = 0; i < lib->book_count; i++) {
+    if (stristr(get_book_field(&lib->books[i], scan->field), scan->term) !=
+        NULL) {
+      scan->hits[scan->count++] = lib->books[i];
+    }
+  }
+  pthread_mutex_unlock(&scan->branch->lock);
+}
+
+void report_branch_search(BranchNetwork *net, SearchField field,
+                          const char *term, RowWriter *out) {
+  BranchScan *scans = malloc(sizeof(BranchScan) * MAX_BRANCHES);
+  if (scans == NULL) {
+    row_writer_message(out, "Out of memory!");
+    return;
+  }
+
+  TaskFunction functions[MAX_BRANCHES];
+  void *args[MAX_BRANCHES];
+  for (int i = 0; i < net->branch_count; i++) {
+    scans[i].branch = &net->branches[i];
+    scans[i].field = field;
+    scans[i].term = term;
+    functions[i] = scan_branch;
+    args[i] = &scans[i];
+  }
+  pool_run(functions, args, net->branch_count);
+
+  bool found = false;
+  for (int i = 0; i < net->branch_count; i++) {
+    for (int j = 0; j < scans[i].count; j++) {
+      const Book *book = &scans[i].hits[j];
+      row_begin(out);
+      row_field_str(out, "Branch", scans[i].branch->name);
+      row_field_int(out, "ID", book->id);
+      row_field_str(out, "Title", book->title);
+      row_field_str(out, "Author", book->author);
+      row_field_str(out, "Genre", book->genre);
+      row_field_str(out, "Status", get_status_name(book->status));
+      row_end(out);
+      found = true;
+    }
+  }
+
+  if (!found) {
+    row_writer_message(out, "No books found!");
+  }
+  free(scans);
+}
+
+/* Fan-out Statistics */
+
+typedef struct {
+  Branch *branch;
+  BranchTotals totals;
+} BranchCount;
+
+static void count_branch(void *arg) {
+  BranchCount *count = arg;
+  Library *lib = count->branch->lib;
+  BranchTotals *totals = &count->totals;
+
+  pthread_mutex_lock(&count->branch->lock);
+  totals->total_books = lib->book_count;
+  totals->total_users = lib->user_count;
+  totals->available_books = 0;
+  totals->borrowed_books = 0;
+  totals->active_borrowers = 0;
+  for (int i = 0; i < lib->book_count; i++) {
+    if (lib->books[i].status == BOOK_AVAILABLE) {
+      totals->available_books++;
+    } else {
+      totals->borrowed_books++;
+    }
+  }
+  for (int i = 0; i < lib->user_count; i++) {
+    if (lib->users[i].borrowed_count > 0) {
+      totals->active_borrowers++;
+    }
+  }
+  pthread_mutex_unlock(&count->branch->lock);
+}
+
+void collect_branch_totals(BranchNetwork *net, BranchTotals *per_branch,
+                           BranchTotals *overall) {
+  BranchCount counts[MAX_BRANCHES];
+  TaskFunction functions[MAX_BRANCHES];
+  void *args[MAX_BRANCHES];
+  for (int i = 0; i < net->branch_count; i++) {
+    counts[i].branch = &net->branches[i];
+    functions[i] = count_branch;
+    args[i] = &counts[i];
+  }
+  pool_run(functions, args, net->branch_count);
+
+  memset(overall, 0, sizeof(*overall));
+  for (int i = 0; i < net->branch_count; i++) {
+    const BranchTotals *t = &counts[i].totals;
+    if (per_branch != NULL) {
+      per_branch[i] = *t;
+    }
+    overall->total_books += t->total_books;
+    overall->available_books += t->available_books;
+    overall->borrowed_books += t->borrowed_books;
+    overall->total_users += t->total_users;
+    overall->active_borrowers += t->active_borrowers;
+  }
+}
+
+static void write_totals_row(RowWriter *out, const char *name,
+                             const BranchTotals *totals) {
+  row_begin(out);
+  row_field_str(out, "Branch", name);
+  row_field_int(out, "Books", totals->total_books);
+  row_field_int(out, "Available", totals->available_books);
+  row_field_int(out, "Borrowed", totals->borrowed_books);
+  row_field_int(out, "Users", totals->total_users);
+  row_field_int(out, "Active Borrowers", totals->active_borrowers);
+  row_end(out);
+}
+
+void display_branch_statistics(BranchNetwork *net) {
+  BranchTotals per_branch[MAX_BRANCHES];
+  BranchTotals overall;
+  collect_branch_totals(net, per_branch, &overall);
+
+  RowWriter out;
+  row_writer_init_stream(&out, stdout, OUTPUT_TABLE);
+  row_writer_title(&out, "Branch Statistics");
+  for (int i = 0; i < net->branch_count; i++) {
+    write_totals_row(&out, net->branches[i].name, &per_branch[i]);
+  }
+  write_totals_row(&out, "All branches", &overall);
+  row_writer_finish(&out);
+}
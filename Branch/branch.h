@@ -0,0 +1,58 @@
+#ifndef BRANCH_H
+#define BRANCH_H
+
+#include <pthread.h>
+
+#include "../Book/book.h"
+#include "../Output/output.h"
+#include "../Storage/storage.h"
+#include "../Utils/utils.h"
+
+/* Branch Constants */
+#define MAX_BRANCHES 8
+#define BRANCH_ID_SPAN 1000000 /* book and user IDs per branch */
+
+/* Type Definitions */
+typedef struct {
+  char name[MAX_NAME_LENGTH];
+  int number; /* IDs from number * BRANCH_ID_SPAN + 1 are issued here */
+  char filename[MAX_PATH_LENGTH];
+  Library *lib;
+  pthread_mutex_t lock;
+} Branch;
+
+typedef struct {
+  Branch branches[MAX_BRANCHES];
+  int branch_count;
+  char journal[MAX_PATH_LENGTH]; /* intent of the transfer in progress */
+} BranchNetwork;
+
+typedef struct {
+  int total_books;
+  int available_books;
+  int borrowed_books;
+  int total_users;
+  int active_borrowers;
+} BranchTotals;
+
+/* Branch Management Functions */
+void init_branch_network(BranchNetwork *net, const char *journal);
+void free_branch_network(BranchNetwork *net);
+ErrorCode add_branch(BranchNetwork *net, const char *name, int number,
+                     const char *filename);
+Branch *find_branch(BranchNetwork *net, const char *name);
+Branch *find_branch_for_book(BranchNetwork *net, int book_id);
+ErrorCode save_branch(Branch *branch);
+ErrorCode save_all_branches(BranchNetwork *net);
+ErrorCode recover_branch_transfer(BranchNetwork *net);
+
+/* Cross-branch Operations */
+ErrorCode transfer_book(BranchNetwork *net, Branch *from, Branch *to,
+                        int book_id);
+void report_branch_search(BranchNetwork *net, SearchField field,
+                          const char *term, RowWriter *out);
+void collect_branch_totals(BranchNetwork *net, BranchTotals *per_branch,
+                           BranchTotals *overall);
+void display_branch_statistics(BranchNetwork *net);
+
+#endif /* BRANCH_H */
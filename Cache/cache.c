@@ -0,0 +1,191 @@
+#include "cache.h"
+
+#include <pthread.h>
+
+/*
+ * LRU cache of search results keyed on (field, lower-cased term). Each entry
+ * remembers the library generation it was computed against, so any mutation
+ * that bumps the generation invalidates every entry without touching them;
+ * stale entries are dropped lazily when looked up or evicted. Lookups copy
+ * the result out under the cache lock, so concurrent readers are safe.
+ */
+
+typedef struct CacheEntry {
+  struct CacheEntry *prev; /* LRU list, most recent first */
+  struct CacheEntry *next;
+  struct CacheEntry *chain; /* hash bucket chain */
+  SearchField field;
+  unsigned long generation;
+  unsigned long hash;
+  size_t bytes;
+  char term[MAX_TITLE_LENGTH];
+  int count;
+  int indices[];
+} CacheEntry;
+
+static CacheEntry *buckets[QUERY_CACHE_BUCKETS];
+static CacheEntry *lru_head = NULL;
+static CacheEntry *lru_tail = NULL;
+static QueryCacheStats stats = {0, 0, 0, 0, 0};
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void normalize_term(const char *term, char *out) {
+  size_t i;
+  for (i = 0; term[i] != '\0' && i < MAX_TITLE_LENGTH - 1; i++) {
+    out[i] = (char)tolower((unsigned char)term[i]);
+  }
+  out[i] = '\0';
+}
+
+static unsigned long hash_key(SearchField field, const char *term) {
+  /* FNV-1a over the field tag and normalized term */
+  unsigned long hash = 2166136261UL ^ (unsigned long)field;
+  for (; *term; term++) {
+    hash ^= (unsigned char)*term;
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static void lru_unlink(CacheEntry *entry) {
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  } else {
+    lru_head = entry->next;
+  }
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  } else {
+    lru_tail = entry->prev;
+  }
+  entry->prev = entry->next = NULL;
+}
+
+static void lru_push_front(CacheEntry *entry) {
+  entry->prev = NULL;
+  entry->next = lru_head;
+  if (lru_head != NULL) {
+    lru_head->prev = entry;
+  }
+  lru_head = entry;
+  if (lru_tail == NULL) {
+    lru_tail = entry;
+  }
+}
+
+static void remove_entry(CacheEntry *entry) {
+  CacheEntry **link = &buckets[entry->hash % QUERY_CACHE_BUCKETS];
+  while (*link != entry) {
+    link = &(*link)->chain;
+  }
+  *link = entry->chain;
+
+  lru_unlink(entry);
+  stats.bytes_used -= entry->bytes;
+  stats.entry_count--;
+  free(entry);
+}
+
+static CacheEntry *find_entry(SearchField field, const char *key,
+                              unsigned long hash) {
+  for (CacheEntry *entry = buckets[hash % QUERY_CACHE_BUCKETS]; entry != NULL;
+       entry = entry->chain) {
+    if (entry->hash == hash && entry->field == field &&
+        strcmp(entry->term, key) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/* Returns the number of cached matches copied to indices, or -1 on a miss */
+int query_cache_lookup(const Library *lib, SearchField field,
+                       const char *term, int *indices) {
+  char key[MAX_TITLE_LENGTH];
+  normalize_term(term, key);
+  unsigned long hash = hash_key(field, key);
+
+  pthread_mutex_lock(&cache_lock);
+  CacheEntry *entry = find_entry(field, key, hash);
+  if (entry != NULL && entry->generation != lib->generation) {
+    remove_entry(entry);
+    entry = NULL;
+  }
+
+  int count = -1;
+  if (entry == NULL) {
+    stats.misses++;
+  } else {
+    stats.hits++;
+    lru_unlink(entry);
+    lru_push_front(entry);
+    count = entry->count;
+    memcpy(indices, entry->indices, (size_t)count * sizeof(int));
+  }
+  pthread_mutex_unlock(&cache_lock);
+  return count;
+}
+
+void query_cache_store(const Library *lib, SearchField field,
+                       const char *term, const int *indices, int count) {
+  size_t bytes = sizeof(CacheEntry) + (size_t)count * sizeof(int);
+  if (bytes > QUERY_CACHE_BUDGET) {
+    return;
+  }
+
+  char key[MAX_TITLE_LENGTH];
+  normalize_term(term, key);
+  unsigned long hash = hash_key(field, key);
+
+  pthread_mutex_lock(&cache_lock);
+  CacheEntry *existing = find_entry(field, key, hash);
+  if (existing != NULL) {
+    remove_entry(existing);
+  }
+
+  while (lru_tail != NULL && stats.bytes_used + bytes > QUERY_CACHE_BUDGET) {
+    remove_entry(lru_tail);
+    stats.evictions++;
+  }
+
+  CacheEntry *entry = malloc(bytes);
+  if (entry == NULL) {
+    pthread_mutex_unlock(&cache_lock);
+    return;
+  }
+  entry->field = field;
+  entry->generation = lib->generation;
+  entry->hash = hash;
+  entry->bytes = bytes;
+  strcpy(entry->term, key);
+  entry->count = count;
+  memcpy(entry->indices, indices, (size_t)count * sizeof(int));
+
+  entry->chain = buckets[hash % QUERY_CACHE_BUCKETS];
+  buckets[hash % QUERY_CACHE_BUCKETS] = entry;
+  lru_push_front(entry);
+  stats.bytes_used += bytes;
+  stats.entry_count++;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void query_cache_clear(void) {
+  pthread_mutex_lock(&cache_lock);
+  while (lru_head != NULL) {
+    remove_entry(lru_head);
+  }
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void query_cache_get_stats(QueryCacheStats *out) {
+  pthread_mutex_lock(&cache_lock);
+  *out = stats;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+double query_cache_hit_ratio(void) {
+  QueryCacheStats current;
+  query_cache_get_stats(&current);
+  unsigned long lookups = current.hits + current.misses;
+  return lookups == 0 ? 0.0 : (double)current.hits / (double)lookups;
+}
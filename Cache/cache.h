@@ -0,0 +1,30 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "../Utils/utils.h"
+
+/* Query Cache Constants */
+#define QUERY_CACHE_BUDGET (32 * 1024) /* bytes of entries + results */
+#define QUERY_CACHE_BUCKETS 64
+
+/* Type Definitions */
+typedef enum { SEARCH_BY_TITLE, SEARCH_BY_AUTHOR, SEARCH_BY_GENRE } SearchField;
+
+typedef struct {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+  size_t bytes_used;
+  int entry_count;
+} QueryCacheStats;
+
+/* Query Cache Functions */
+int query_cache_lookup(const Library *lib, SearchField field,
+                       const char *term, int *indices);
+void query_cache_store(const Library *lib, SearchField field,
+                       const char *term, const int *indices, int count);
+void query_cache_clear(void);
+void query_cache_get_stats(QueryCacheStats *stats);
+double query_cache_hit_ratio(void);
+
+#endif /* CACHE_H */
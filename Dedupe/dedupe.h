@@ -0,0 +1,28 @@
+#ifndef DEDUPE_H
+#define DEDUPE_H
+
+#include "../Output/output.h"
+#include "../Utils/utils.h"
+
+/* Deduplication Constants */
+#define MINHASH_SIZE 24
+#define LSH_BANDS 8
+#define LSH_ROWS (MINHASH_SIZE / LSH_BANDS)
+#define NEAR_DUPLICATE_THRESHOLD 0.7
+
+/* Type Definitions */
+typedef struct {
+  int keep;         /* index of the record to keep, -1 for kept records */
+  bool exact;       /* same normalized title and author as the kept one */
+  float similarity; /* estimated Jaccard similarity to the kept record */
+} DuplicateMatch;
+
+/* Deduplication Functions */
+ErrorCode find_duplicate_books(const Book *books, int count,
+                               DuplicateMatch *matches, int *duplicates);
+
+/* Report Functions */
+void report_duplicate_books(Library *lib, RowWriter *out);
+void display_duplicate_books(Library *lib);
+
+#endif /* DEDUPE_H */
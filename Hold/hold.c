@@ -0,0 +1,226 @@
+#include "hold.h"
+#include "../Book/book.h"
+#include "../Management/management.h"
+#include "../Trace/trace.h"
+#include "../User/user.h"
+
+/*
+ * Each book keeps a FIFO queue of holds as a singly linked list threaded
+ * through the Library.holds pool by index; unused entries form a free
+ * list. Appending at the tail and promoting from the head are O(1) and a
+ * copy of the Library (batches, background saves, versioned snapshots)
+ * copies the queues with it.
+ */
+
+/* Hold Pool */
+
+void clear_holds(Library *lib) {
+  for (int i = 0; i < MAX_HOLDS - 1; i++) {
+    lib->holds[i].next = i + 1;
+  }
+  lib->holds[MAX_HOLDS - 1].next = NO_HOLD;
+  lib->hold_free = 0;
+  lib->hold_count = 0;
+
+  for (int i = 0; i < lib->book_count; i++) {
+    lib->books[i].hold_head = NO_HOLD;
+    lib->books[i].hold_tail = NO_HOLD;
+  }
+}
+
+ErrorCode append_hold(Library *lib, Book *book, int user_id, time_t placed) {
+  int entry = lib->hold_free;
+  if (entry == NO_HOLD) {
+    return ERROR_MAX_HOLDS_REACHED;
+  }
+  lib->hold_free = lib->holds[entry].next;
+
+  HoldEntry *hold = &lib->holds[entry];
+  hold->book_id = book->id;
+  hold->user_id = user_id;
+  hold->placed = placed;
+  hold->next = NO_HOLD;
+
+  if (book->hold_tail == NO_HOLD) {
+    book->hold_head = entry;
+  } else {
+    lib->holds[book->hold_tail].next = entry;
+  }
+  book->hold_tail = entry;
+  lib->hold_count++;
+  return SUCCESS;
+}
+
+/* Unlinks the entry after prev (the head when prev is NO_HOLD) */
+static void unlink_hold(Library *lib, Book *book, int prev, int entry) {
+  int next = lib->holds[entry].next;
+  if (prev == NO_HOLD) {
+    book->hold_head = next;
+  } else {
+    lib->holds[prev].next = next;
+  }
+  if (book->hold_tail == entry) {
+    book->hold_tail = prev;
+  }
+
+  lib->holds[entry].next = lib->hold_free;
+  lib->hold_free = entry;
+  lib->hold_count--;
+}
+
+void write_hold_records(FILE *file, const Library *lib) {
+  for (int i = 0; i < lib->book_count; i++) {
+    for (int entry = lib->books[i].hold_head; entry != NO_HOLD;
+         entry = lib->holds[entry].next) {
+      const HoldEntry *hold = &lib->holds[entry];
+      fprintf(file, "HOLD|%d|%d|%ld\n", hold->book_id, hold->user_id,
+              (long)hold->placed);
+    }
+  }
+}
+
+void parse_hold_record(Library *lib, char *line) {
+  int book_id, user_id;
+  long placed;
+  if (sscanf(line, "HOLD|%d|%d|%ld", &book_id, &user_id, &placed) != 3) {
+    return;
+  }
+
+  Book *book = find_book_by_id(lib, book_id);
+  if (book != NULL) {
+    append_hold(lib, book, user_id, (time_t)placed);
+  }
+}
+
+/* Hold Management Functions */
+
+ErrorCode place_hold(Library *lib, int user_id, int book_id) {
+  return place_hold_at(lib, user_id, book_id, time(NULL));
+}
+
+ErrorCode place_hold_at(Library *lib, int user_id, int book_id, time_t when) {
+  trace_loan(TRACE_PLACE_HOLD, user_id, book_id, when);
+  User *user = find_user_by_id(lib, user_id);
+  if (user == NULL) {
+    return ERROR_USER_NOT_FOUND;
+  }
+
+  Book *book = find_book_by_id(lib, book_id);
+  if (book == NULL) {
+    return ERROR_BOOK_NOT_FOUND;
+  }
+
+  if (book->status == BOOK_AVAILABLE) {
+    return ERROR_BOOK_AVAILABLE;
+  }
+
+  if (book->borrower_id == user_id) {
+    return ERROR_ALREADY_ON_HOLD;
+  }
+  for (int entry = book->hold_head; entry != NO_HOLD;
+       entry = lib->holds[entry].next) {
+    if (lib->holds[entry].user_id == user_id) {
+      return ERROR_ALREADY_ON_HOLD;
+    }
+  }
+
+  ErrorCode result = append_hold(lib, book, user_id, when);
+  if (result == SUCCESS) {
+    library_touch(lib);
+  }
+  return result;
+}
+
+ErrorCode cancel_hold(Library *lib, int user_id, int book_id) {
+  trace_loan(TRACE_CANCEL_HOLD, user_id, book_id, 0);
+  Book *book = find_book_by_id(lib, book_id);
+  if (book == NULL) {
+    return ERROR_BOOK_NOT_FOUND;
+  }
+
+  int prev = NO_HOLD;
+  for (int entry = book->hold_head; entry != NO_HOLD;
+       entry = lib->holds[entry].next) {
+    if (lib->holds[entry].user_id == user_id) {
+      unlink_hold(lib, book, prev, entry);
+      library_touch(lib);
+      return SUCCESS;
+    }
+    prev = entry;
+  }
+  return ERROR_HOLD_NOT_FOUND;
+}
+
+/*
+ * Called once a book has been returned: lends it to the oldest hold whose
+ * patron can still borrow. Holds of patrons who were deleted or are at
+ * their borrow limit are dropped. Returns the new borrower, or NO_BORROWER
+ * when the queue ran empty and the book stays available.
+ */
+int promote_next_hold(Library *lib, Book *book, time_t when) {
+  int promoted = NO_BORROWER;
+  trace_suppress(); /* replaying the return repeats this borrow */
+  while (promoted == NO_BORROWER && book->hold_head != NO_HOLD) {
+    int user_id = lib->holds[book->hold_head].user_id;
+    unlink_hold(lib, book, NO_HOLD, book->hold_head);
+    if (borrow_book_at(lib, user_id, book->id, when) == SUCCESS) {
+      promoted = user_id;
+    }
+  }
+  trace_resume();
+  return promoted;
+}
+
+void drop_user_holds(Library *lib, int user_id) {
+  for (int i = 0; i < lib->book_count; i++) {
+    Book *book = &lib->books[i];
+    int prev = NO_HOLD;
+    int entry = book->hold_head;
+    while (entry != NO_HOLD) {
+      int next = lib->holds[entry].next;
+      if (lib->holds[entry].user_id == user_id) {
+        unlink_hold(lib, book, prev, entry);
+      } else {
+        prev = entry;
+      }
+      entry = next;
+    }
+  }
+  library_touch(lib);
+}
+
+/* Report Functions */
+
+void report_holds(Library *lib, int book_id, RowWriter *out) {
+  Book *book = find_book_by_id(lib, book_id);
+  if (book == NULL) {
+    row_writer_message(out, "Book not found!");
+    return;
+  }
+  if (book->hold_head == NO_HOLD) {
+    row_writer_message(out, "No holds on this book!");
+    return;
+  }
+
+  int position = 1;
+  for (int entry = book->hold_head; entry != NO_HOLD;
+       entry = lib->holds[entry].next) {
+    const HoldEntry *hold = &lib->holds[entry];
+    User *user = find_user_by_id(lib, hold->user_id);
+
+    row_begin(out);
+    row_field_int(out, "Position", position++);
+    row_field_int(out, "User ID", hold->user_id);
+    row_field_str(out, "Name", user != NULL ? user->name : "");
+    row_field_time(out, "Placed", hold->placed);
+    row_end(out);
+  }
+}
+
+void display_holds(Library *lib, int book_id) {
+  RowWriter out;
+  row_writer_init_stream(&out, stdout, OUTPUT_TABLE);
+  row_writer_title(&out, "Hold Queue");
+  report_holds(lib, book_id, &out);
+  row_writer_finish(&out);
+}
@@ -0,0 +1,24 @@
+#ifndef HOLD_H
+#define HOLD_H
+
+#include "../Output/output.h"
+#include "../Utils/utils.h"
+
+/* Hold Management Functions */
+ErrorCode place_hold(Library *lib, int user_id, int book_id);
+ErrorCode place_hold_at(Library *lib, int user_id, int book_id, time_t when);
+ErrorCode cancel_hold(Library *lib, int user_id, int book_id);
+int promote_next_hold(Library *lib, Book *book, time_t when);
+void drop_user_holds(Library *lib, int user_id);
+
+/* Report Functions */
+void report_holds(Library *lib, int book_id, RowWriter *out);
+void display_holds(Library *lib, int book_id);
+
+/* Hold Pool */
+void clear_holds(Library *lib);
+ErrorCode append_hold(Library *lib, Book *book, int user_id, time_t placed);
+void write_hold_records(FILE *file, const Library *lib);
+void parse_hold_record(Library *lib, char *line);
+
+#endif /* HOLD_H */
@@ -1,8 +1,20 @@
 #include "management.h"
+#include "../Analytics/analytics.h"
+#include "../Dedupe/dedupe.h"
+#include "../Hold/hold.h"
+#include "../Parallel/parallel.h"
+#include "../Trace/trace.h"
 
 /* Borrow/Return Functions */
 
 ErrorCode borrow_book(Library *lib, int user_id, int book_id) {
+  return borrow_book_at(lib, user_id, book_id, time(NULL));
+}
+
+/* Borrows as of the given time, so replays reproduce the same dates */
+ErrorCode borrow_book_at(Library *lib, int user_id, int book_id,
+                         time_t when) {
+  trace_loan(TRACE_BORROW, user_id, book_id, when);
   User *user = find_user_by_id(lib, user_id);
   if (user == NULL) {
     return ERROR_USER_NOT_FOUND;
@@ -24,13 +36,22 @@ ErrorCode borrow_book(Library *lib, int user_id, int book_id) {
   book->status = BOOK_BORROWED;
   book->borrower_id = user_id;
   user->borrowed_book_ids[user->borrowed_count] = book_id;
-  user->borrow_dates[user->borrowed_count] = time(NULL);
+  user->borrow_dates[user->borrowed_count] = when;
   user->borrowed_count++;
+  record_checkout(&lib->circulation, book, when);
 
+  mark_book_dirty(lib, (int)(book - lib->books));
+  mark_user_dirty(lib, (int)(user - lib->users));
   return SUCCESS;
 }
 
 ErrorCode return_book(Library *lib, int user_id, int book_id) {
+  return return_book_at(lib, user_id, book_id, time(NULL));
+}
+
+ErrorCode return_book_at(Library *lib, int user_id, int book_id,
+                         time_t when) {
+  trace_loan(TRACE_RETURN, user_id, book_id, when);
   User *user = find_user_by_id(lib, user_id);
   if (user == NULL) {
     return ERROR_USER_NOT_FOUND;
@@ -64,93 +85,166 @@ ErrorCode return_book(Library *lib, int user_id, int book_id) {
     user->borrowed_count--;
   }
 
+  mark_book_dirty(lib, (int)(book - lib->books));
+  mark_user_dirty(lib, (int)(user - lib->users));
+  record_return(&lib->circulation, when);
+  promote_next_hold(lib, book, when);
   return SUCCESS;
 }
 
-/* Display Functions */
+/* Report Functions */
 
-void display_available_books(Library *lib) {
-  printf("\n=== Available Books ===\n");
+void report_available_books(Library *lib, RowWriter *out) {
   bool has_available = false;
 
   for (int i = 0; i < lib->book_count; i++) {
     if (lib->books[i].status == BOOK_AVAILABLE) {
-      printf("ID: %d | Title: %s | Author: %s | Genre: %s\n", lib->books[i].id,
-             lib->books[i].title, lib->books[i].author, lib->books[i].genre);
+      row_write_book(out, &lib->books[i], false);
       has_available = true;
     }
   }
 
   if (!has_available) {
-    printf("No available books!\n");
+    row_writer_message(out, "No available books!");
   }
 }
 
-void display_user_info(Library *lib, int user_id) {
+void report_user_info(Library *lib, int user_id, RowWriter *out) {
   User *user = find_user_by_id(lib, user_id);
   if (user == NULL) {
-    printf("User not found!\n");
+    row_writer_message(out, "User not found!");
     return;
   }
 
-  printf("\n=== User Information ===\n");
-  printf("ID: %d | Name: %s\n", user->id, user->name);
-  printf("Borrowed books count: %d\n", user->borrowed_count);
-
-  if (user->borrowed_count > 0) {
-    printf("Borrowed books list:\n");
-    for (int i = 0; i < user->borrowed_count; i++) {
-      Book *book = find_book_by_id(lib, user->borrowed_book_ids[i]);
-      if (book != NULL) {
-        char borrow_date[DATE_LENGTH];
-        char due_date_str[DATE_LENGTH];
-        time_t due_date =
-            calculate_due_date(user->borrow_dates[i], BORROW_PERIOD_DAYS);
-
-        format_time(user->borrow_dates[i], borrow_date, DATE_LENGTH);
-        format_time(due_date, due_date_str, DATE_LENGTH);
-
-        printf("  - [%d] %s (Author: %s)\n", book->id, book->title,
-               book->author);
-        printf("    Borrowed: %s | Due: %s", borrow_date, due_date_str);
+  row_begin(out);
+  row_field_int(out, "ID", user->id);
+  row_field_str(out, "Name", user->name);
+  row_field_int(out, "Borrowed books", user->borrowed_count);
+  row_end(out);
 
-        if (is_overdue(due_date)) {
-          printf(" [OVERDUE!]");
-        }
-        printf("\n");
-      }
+  for (int i = 0; i < user->borrowed_count; i++) {
+    Book *book = find_book_by_id(lib, user->borrowed_book_ids[i]);
+    if (book != NULL) {
+      time_t due_date =
+          calculate_due_date(user->borrow_dates[i], BORROW_PERIOD_DAYS);
+
+      row_begin(out);
+      row_field_int(out, "Book ID", book->id);
+      row_field_str(out, "Title", book->title);
+      row_field_str(out, "Author", book->author);
+      row_field_time(out, "Borrowed", user->borrow_dates[i]);
+      row_field_time(out, "Due", due_date);
+      row_field_str(out, "Overdue", is_overdue(due_date) ? "yes" : "no");
+      row_end(out);
     }
   }
 }
 
-void display_all_books(Library *lib) {
-  printf("\n=== All Books ===\n");
+void report_all_books(Library *lib, RowWriter *out) {
   if (lib->book_count == 0) {
-    printf("No books in library!\n");
+    row_writer_message(out, "No books in library!");
     return;
   }
 
   for (int i = 0; i < lib->book_count; i++) {
-    printf("ID: %d | Title: %s | Author: %s | Genre: %s | Status: %s\n",
-           lib->books[i].id, lib->books[i].title, lib->books[i].author,
-           lib->books[i].genre,
-           lib->books[i].status == BOOK_AVAILABLE ? "Available" : "Borrowed");
+    row_write_book(out, &lib->books[i], true);
   }
 }
 
-void display_all_users(Library *lib) {
-  printf("\n=== All Users ===\n");
+void report_all_users(Library *lib, RowWriter *out) {
   if (lib->user_count == 0) {
-    printf("No users!\n");
+    row_writer_message(out, "No users!");
     return;
   }
 
   for (int i = 0; i < lib->user_count; i++) {
-    printf("ID: %d | Name: %s | Borrowed books: %d\n", lib->users[i].id,
-           lib->users[i].name, lib->users[i].borrowed_count);
+    row_begin(out);
+    row_field_int(out, "ID", lib->users[i].id);
+    row_field_str(out, "Name", lib->users[i].name);
+    row_field_int(out, "Borrowed books", lib->users[i].borrowed_count);
+    row_end(out);
   }
 }
 
+static bool has_overdue_loan(int index, void *context) {
+  const User *user = &((const Library *)context)->users[index];
+  for (int j = 0; j < user->borrowed_count; j++) {
+    if (is_overdue(
+            calculate_due_date(user->borrow_dates[j], BORROW_PERIOD_DAYS))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void report_overdue_books(Library *lib, RowWriter *out) {
+  bool has_overdue = false;
+  time_t now = time(NULL);
+
+  int borrowers[MAX_USERS];
+  int count = parallel_scan(lib->user_count, has_overdue_loan, lib, borrowers);
+
+  for (int i = 0; i < count; i++) {
+    User *user = &lib->users[borrowers[i]];
+    for (int j = 0; j < user->borrowed_count; j++) {
+      time_t due_date =
+          calculate_due_date(user->borrow_dates[j], BORROW_PERIOD_DAYS);
+      if (is_overdue(due_date)) {
+        Book *book = find_book_by_id(lib, user->borrowed_book_ids[j]);
+        if (book != NULL) {
+          row_begin(out);
+          row_field_str(out, "Book", book->title);
+          row_field_int(out, "Book ID", book->id);
+          row_field_str(out, "Borrower", user->name);
+          row_field_int(out, "Borrower ID", user->id);
+          row_field_time(out, "Due Date", due_date);
+          row_field_int(out, "Days Overdue",
+                        (int)((now - due_date) / (24 * 60 * 60)));
+          row_end(out);
+          has_overdue = true;
+        }
+      }
+    }
+  }
+
+  if (!has_overdue) {
+    row_writer_message(out, "No overdue books!");
+  }
+}
+
+/* Display Functions */
+
+typedef void (*ReportFunction)(Library *lib, RowWriter *out);
+
+static void display_report(Library *lib, const char *title,
+                           ReportFunction report) {
+  RowWriter out;
+  row_writer_init_stream(&out, stdout, OUTPUT_TABLE);
+  row_writer_title(&out, title);
+  report(lib, &out);
+  row_writer_finish(&out);
+}
+
+void display_available_books(Library *lib) {
+  display_report(lib, "Available Books", report_available_books);
+}
+
+void display_user_info(Library *lib, int user_id) {
+  RowWriter out;
+  row_writer_init_stream(&out, stdout, OUTPUT_TABLE);
+  row_writer_title(&out, "User Information");
+  report_user_info(lib, user_id, &out);
+  row_writer_finish(&out);
+}
+
+void display_all_books(Library *lib) {
+  display_report(lib, "All Books", report_all_books);
+}
+
+void display_all_users(Library *lib) {
+  display_report(lib, "All Users", report_all_users);
+}
+
 void display_statistics(Library *lib) {
   printf("\n=== Library Statistics ===\n");
 
@@ -175,40 +269,59 @@ void display_statistics(Library *lib) {
   printf("Total Books: %d\n", lib->book_count);
   printf("  - Available: %d\n", available_books);
   printf("  - Borrowed: %d\n", borrowed_books);
+  printf("  - Holds waiting: %d\n", lib->hold_count);
   printf("\nTotal Users: %d\n", lib->user_count);
   printf("  - Active Borrowers: %d\n", active_borrowers);
   printf("  - Inactive: %d\n", lib->user_count - active_borrowers);
+
+  QueryCacheStats cache_stats;
+  query_cache_get_stats(&cache_stats);
+  printf("\nSearch Cache: %lu hits / %lu misses (%.1f%% hit ratio)\n",
+         cache_stats.hits, cache_stats.misses, query_cache_hit_ratio() * 100.0);
+  printf("  - Entries: %d (%lu bytes, %lu evictions)\n",
+         cache_stats.entry_count, (unsigned long)cache_stats.bytes_used,
+         cache_stats.evictions);
+
+  display_circulation(&lib->circulation);
 }
 
 void display_overdue_books(Library *lib) {
-  printf("\n=== Overdue Books ===\n");
-  bool has_overdue = false;
+  display_report(lib, "Overdue Books", report_overdue_books);
+}
 
-  for (int i = 0; i < lib->user_count; i++) {
-    User *user = &lib->users[i];
-    for (int j = 0; j < user->borrowed_count; j++) {
-      time_t due_date =
-          calculate_due_date(user->borrow_dates[j], BORROW_PERIOD_DAYS);
-      if (is_overdue(due_date)) {
-        Book *book = find_book_by_id(lib, user->borrowed_book_ids[j]);
-        if (book != NULL) {
-          char due_date_str[DATE_LENGTH];
-          format_time(due_date, due_date_str, DATE_LENGTH);
+/* Export Functions */
 
-          time_t now = time(NULL);
-          int days_overdue = (int)((now - due_date) / (24 * 60 * 60));
+ErrorCode export_report(Library *lib, ReportKind kind, OutputFormat format,
+                        const char *filename) {
+  FILE *file = fopen(filename, "w");
+  if (file == NULL) {
+    return ERROR_FILE_IO;
+  }
 
-          printf("Book: %s (ID: %d)\n", book->title, book->id);
-          printf("  Borrower: %s (ID: %d)\n", user->name, user->id);
-          printf("  Due Date: %s\n", due_date_str);
-          printf("  Days Overdue: %d\n\n", days_overdue);
-          has_overdue = true;
-        }
-      }
-    }
+  RowWriter out;
+  row_writer_init_stream(&out, file, format);
+
+  switch (kind) {
+  case REPORT_AVAILABLE_BOOKS:
+    report_available_books(lib, &out);
+    break;
+  case REPORT_ALL_USERS:
+    report_all_users(lib, &out);
+    break;
+  case REPORT_OVERDUE_BOOKS:
+    report_overdue_books(lib, &out);
+    break;
+  case REPORT_DUPLICATE_BOOKS:
+    report_duplicate_books(lib, &out);
+    break;
+  default:
+    report_all_books(lib, &out);
+    break;
   }
 
-  if (!has_overdue) {
-    printf("No overdue books!\n");
+  ErrorCode result = row_writer_finish(&out);
+  if (fclose(file) != 0) {
+    result = ERROR_FILE_IO;
   }
+  return result;
 }
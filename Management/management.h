@@ -2,13 +2,24 @@
 #define MANAGEMENT_H
 
 #include "../Book/book.h"
+#include "../Output/output.h"
 #include "../User/user.h"
 #include "../Utils/utils.h"
 
+/* Type Definitions */
+typedef enum {
+  REPORT_ALL_BOOKS,
+  REPORT_AVAILABLE_BOOKS,
+  REPORT_ALL_USERS,
+  REPORT_OVERDUE_BOOKS,
+  REPORT_DUPLICATE_BOOKS
+} ReportKind;
 
 /* Borrow/Return Management */
 ErrorCode borrow_book(Library *lib, int user_id, int book_id);
 ErrorCode return_book(Library *lib, int user_id, int book_id);
+ErrorCode borrow_book_at(Library *lib, int user_id, int book_id, time_t when);
+ErrorCode return_book_at(Library *lib, int user_id, int book_id, time_t when);
 
 /* Display Functions */
 void display_available_books(Library *lib);
@@ -18,4 +29,13 @@ void display_all_users(Library *lib);
 void display_statistics(Library *lib);
 void display_overdue_books(Library *lib);
 
+/* Report Functions */
+void report_available_books(Library *lib, RowWriter *out);
+void report_user_info(Library *lib, int user_id, RowWriter *out);
+void report_all_books(Library *lib, RowWriter *out);
+void report_all_users(Library *lib, RowWriter *out);
+void report_overdue_books(Library *lib, RowWriter *out);
+ErrorCode export_report(Library *lib, ReportKind kind, OutputFormat format,
+                        const char *filename);
+
 #endif /* MANAGEMENT_H */
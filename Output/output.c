@@ -0,0 +1,279 @@
+#include "output.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+/*
+ * Rows are assembled in a small line buffer and appended to one large output
+ * buffer, which is only handed to the sink when it fills up or the writer is
+ * finished. Table output reproduces the "Label: value | Label: value" lines
+ * the console has always shown; CSV takes its header from the labels of the
+ * first row and JSON lower-cases them into keys.
+ */
+
+static void writer_init(RowWriter *out, OutputSink sink, OutputFormat format) {
+  out->format = format;
+  out->sink = sink;
+  out->stream = NULL;
+  out->fd = -1;
+  out->error = SUCCESS;
+  out->row_count = 0;
+  out->field_count = 0;
+  out->used = 0;
+  out->line_used = 0;
+  out->header_used = 0;
+}
+
+void row_writer_init_stream(RowWriter *out, FILE *stream, OutputFormat format) {
+  writer_init(out, SINK_STREAM, format);
+  out->stream = stream;
+}
+
+void row_writer_init_fd(RowWriter *out, int fd, OutputFormat format) {
+  writer_init(out, SINK_FD, format);
+  out->fd = fd;
+}
+
+void row_writer_init_null(RowWriter *out, OutputFormat format) {
+  writer_init(out, SINK_NULL, format);
+}
+
+ErrorCode row_writer_flush(RowWriter *out) {
+  if (out->used == 0 || out->error != SUCCESS) {
+    out->used = 0;
+    return out->error;
+  }
+
+  if (out->sink == SINK_STREAM) {
+    if (fwrite(out->buffer, 1, out->used, out->stream) != out->used) {
+      out->error = ERROR_FILE_IO;
+    }
+  } else if (out->sink == SINK_FD) {
+    size_t written = 0;
+    while (written < out->used) {
+      ssize_t n = write(out->fd, out->buffer + written, out->used - written);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        out->error = ERROR_FILE_IO;
+        break;
+      }
+      written += (size_t)n;
+    }
+  }
+
+  out->used = 0;
+  return out->error;
+}
+
+static void emit(RowWriter *out, const char *data, size_t len) {
+  while (len > 0) {
+    if (out->used == OUTPUT_BUFFER_SIZE) {
+      row_writer_flush(out);
+    }
+    size_t chunk = OUTPUT_BUFFER_SIZE - out->used;
+    if (chunk > len) {
+      chunk = len;
+    }
+    memcpy(out->buffer + out->used, data, chunk);
+    out->used += chunk;
+    data += chunk;
+    len -= chunk;
+  }
+}
+
+static void emit_str(RowWriter *out, const char *str) {
+  emit(out, str, strlen(str));
+}
+
+/* Appends to the current row; overlong rows are truncated, not split */
+static void line_append(RowWriter *out, const char *data, size_t len) {
+  size_t room = OUTPUT_LINE_SIZE - out->line_used;
+  if (len > room) {
+    len = room;
+  }
+  memcpy(out->line + out->line_used, data, len);
+  out->line_used += len;
+}
+
+static void line_append_str(RowWriter *out, const char *str) {
+  line_append(out, str, strlen(str));
+}
+
+static void header_append(RowWriter *out, const char *str) {
+  size_t len = strlen(str);
+  size_t room = OUTPUT_HEADER_SIZE - out->header_used;
+  if (len > room) {
+    len = room;
+  }
+  memcpy(out->header + out->header_used, str, len);
+  out->header_used += len;
+}
+
+static void append_csv_value(RowWriter *out, const char *value) {
+  if (strpbrk(value, ",\"\n") == NULL) {
+    line_append_str(out, value);
+    return;
+  }
+
+  line_append(out, "\"", 1);
+  for (; *value; value++) {
+    if (*value == '"') {
+      line_append(out, "\"", 1);
+    }
+    line_append(out, value, 1);
+  }
+  line_append(out, "\"", 1);
+}
+
+static void append_json_string(RowWriter *out, const char *value) {
+  line_append(out, "\"", 1);
+  for (; *value; value++) {
+    unsigned char c = (unsigned char)*value;
+    if (c == '"' || c == '\\') {
+      line_append(out, "\\", 1);
+      line_append(out, value, 1);
+    } else if (c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      line_append_str(out, escaped);
+    } else {
+      line_append(out, value, 1);
+    }
+  }
+  line_append(out, "\"", 1);
+}
+
+static void append_json_key(RowWriter *out, const char *name) {
+  line_append(out, "\"", 1);
+  for (; *name; name++) {
+    char c = *name == ' ' ? '_' : (char)tolower((unsigned char)*name);
+    line_append(out, &c, 1);
+  }
+  line_append_str(out, "\": ");
+}
+
+static void begin_field(RowWriter *out, const char *name) {
+  bool first = out->field_count == 0;
+
+  switch (out->format) {
+  case OUTPUT_TABLE:
+    if (!first) {
+      line_append_str(out, " | ");
+    }
+    line_append_str(out, name);
+    line_append_str(out, ": ");
+    break;
+  case OUTPUT_CSV:
+    if (!first) {
+      line_append(out, ",", 1);
+    }
+    if (out->row_count == 0) {
+      if (!first) {
+        header_append(out, ",");
+      }
+      header_append(out, name);
+    }
+    break;
+  case OUTPUT_JSON:
+    if (!first) {
+      line_append_str(out, ", ");
+    }
+    append_json_key(out, name);
+    break;
+  }
+
+  out->field_count++;
+}
+
+void row_writer_title(RowWriter *out, const char *title) {
+  if (out->format == OUTPUT_TABLE) {
+    emit_str(out, "\n=== ");
+    emit_str(out, title);
+    emit_str(out, " ===\n");
+  }
+}
+
+void row_writer_message(RowWriter *out, const char *message) {
+  if (out->format == OUTPUT_TABLE) {
+    emit_str(out, message);
+    emit_str(out, "\n");
+  }
+}
+
+void row_begin(RowWriter *out) {
+  out->field_count = 0;
+  out->line_used = 0;
+  if (out->format == OUTPUT_JSON) {
+    line_append_str(out, "  {");
+  }
+}
+
+void row_field_int(RowWriter *out, const char *name, int value) {
+  char digits[16];
+  snprintf(digits, sizeof(digits), "%d", value);
+  begin_field(out, name);
+  line_append_str(out, digits);
+}
+
+void row_field_str(RowWriter *out, const char *name, const char *value) {
+  begin_field(out, name);
+  switch (out->format) {
+  case OUTPUT_TABLE:
+    line_append_str(out, value);
+    break;
+  case OUTPUT_CSV:
+    append_csv_value(out, value);
+    break;
+  case OUTPUT_JSON:
+    append_json_string(out, value);
+    break;
+  }
+}
+
+void row_field_time(RowWriter *out, const char *name, time_t value) {
+  char date[DATE_LENGTH];
+  format_time(value, date, DATE_LENGTH);
+  row_field_str(out, name, date);
+}
+
+void row_end(RowWriter *out) {
+  if (out->format == OUTPUT_CSV && out->row_count == 0) {
+    emit(out, out->header, out->header_used);
+    emit_str(out, "\n");
+  } else if (out->format == OUTPUT_JSON) {
+    emit_str(out, out->row_count == 0 ? "[\n" : ",\n");
+    line_append(out, "}", 1);
+  }
+
+  emit(out, out->line, out->line_used);
+  if (out->format != OUTPUT_JSON) {
+    emit_str(out, "\n");
+  }
+  out->row_count++;
+}
+
+void row_write_book(RowWriter *out, const Book *book, bool with_status) {
+  row_begin(out);
+  row_field_int(out, "ID", book->id);
+  row_field_str(out, "Title", book->title);
+  row_field_str(out, "Author", book->author);
+  row_field_str(out, "Genre", book->genre);
+  if (with_status) {
+    row_field_str(out, "Status", get_status_name(book->status));
+  }
+  row_end(out);
+}
+
+ErrorCode row_writer_finish(RowWriter *out) {
+  if (out->format == OUTPUT_JSON) {
+    emit_str(out, out->row_count == 0 ? "[]\n" : "\n]\n");
+  }
+
+  row_writer_flush(out);
+  if (out->sink == SINK_STREAM && fflush(out->stream) != 0) {
+    out->error = ERROR_FILE_IO;
+  }
+  return out->error;
+}
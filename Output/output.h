@@ -0,0 +1,51 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "../Utils/utils.h"
+
+/* Output Constants */
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
+#define OUTPUT_LINE_SIZE 1024
+#define OUTPUT_HEADER_SIZE 256
+
+/* Type Definitions */
+typedef enum { OUTPUT_TABLE, OUTPUT_CSV, OUTPUT_JSON } OutputFormat;
+
+typedef enum { SINK_STREAM, SINK_FD, SINK_NULL } OutputSink;
+
+typedef struct {
+  OutputFormat format;
+  OutputSink sink;
+  FILE *stream;
+  int fd;
+  ErrorCode error;
+  int row_count;
+  int field_count;
+  size_t used;
+  size_t line_used;
+  size_t header_used;
+  char line[OUTPUT_LINE_SIZE];
+  char header[OUTPUT_HEADER_SIZE];
+  char buffer[OUTPUT_BUFFER_SIZE];
+} RowWriter;
+
+/* Row Writer Setup */
+void row_writer_init_stream(RowWriter *out, FILE *stream, OutputFormat format);
+void row_writer_init_fd(RowWriter *out, int fd, OutputFormat format);
+void row_writer_init_null(RowWriter *out, OutputFormat format);
+ErrorCode row_writer_flush(RowWriter *out);
+ErrorCode row_writer_finish(RowWriter *out);
+
+/* Table-only Decorations */
+void row_writer_title(RowWriter *out, const char *title);
+void row_writer_message(RowWriter *out, const char *message);
+
+/* Row Building */
+void row_begin(RowWriter *out);
+void row_field_int(RowWriter *out, const char *name, int value);
+void row_field_str(RowWriter *out, const char *name, const char *value);
+void row_field_time(RowWriter *out, const char *name, time_t value);
+void row_end(RowWriter *out);
+void row_write_book(RowWriter *out, const Book *book, bool with_status);
+
+#endif /* OUTPUT_H */
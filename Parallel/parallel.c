@@ -0,0 +1,350 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+ * Work-stealing pool: every worker owns a deque of tasks. pool_run() deals
+ * a batch of tasks round-robin across the deques; a worker pops its own
+ * deque from the back and, when that is empty, steals from the front of
+ * the others, so uneven chunks even out. The submitting thread works
+ * through the deques as well while it waits for its batch to finish.
+ *
+ * The workers are started on the first batch that wants them rather than
+ * at startup: with the default threshold a desk-sized catalog never scans
+ * in parallel, and an idle thread per CPU would be pure overhead.
+ */
+
+typedef struct Batch Batch;
+
+typedef struct {
+  TaskFunction function;
+  void *arg;
+  Batch *batch;
+} Task;
+
+typedef struct {
+  pthread_mutex_t lock;
+  Task tasks[POOL_QUEUE_SIZE];
+  int head; /* steal end */
+  int tail; /* owner end */
+} Deque;
+
+struct Batch {
+  atomic_int remaining;
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+};
+
+static Deque deques[POOL_MAX_WORKERS];
+static pthread_t threads[POOL_MAX_WORKERS];
+static atomic_int worker_count = 0;
+static int requested_workers = 0; /* 0: one per CPU */
+static bool start_failed = false;
+static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_available = PTHREAD_COND_INITIALIZER;
+static atomic_int queued = 0;
+static bool stopping = false;
+static int scan_threshold = PARALLEL_SCAN_THRESHOLD;
+
+static bool deque_push(Deque *deque, Task task) {
+  pthread_mutex_lock(&deque->lock);
+  bool pushed = deque->tail - deque->head < POOL_QUEUE_SIZE;
+  if (pushed) {
+    deque->tasks[deque->tail++ % POOL_QUEUE_SIZE] = task;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return pushed;
+}
+
+static bool deque_pop(Deque *deque, Task *task, bool steal) {
+  pthread_mutex_lock(&deque->lock);
+  bool popped = deque->tail > deque->head;
+  if (popped) {
+    *task = steal ? deque->tasks[deque->head++ % POOL_QUEUE_SIZE]
+                  : deque->tasks[--deque->tail % POOL_QUEUE_SIZE];
+  }
+  if (deque->head == deque->tail) {
+    deque->head = deque->tail = 0;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return popped;
+}
+
+/* Own deque first, then steal starting from the next worker */
+static bool find_task(int self, Task *task) {
+  if (self >= 0 && deque_pop(&deques[self], task, false)) {
+    return true;
+  }
+  int workers = atomic_load(&worker_count);
+  int start = self < 0 ? 0 : self + 1;
+  for (int i = 0; i < workers; i++) {
+    int victim = (start + i) % workers;
+    if (victim != self && deque_pop(&deques[victim], task, true)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void run_task(const Task *task) {
+  atomic_fetch_sub(&queued, 1);
+  task->function(task->arg);
+
+  Batch *batch = task->batch;
+  if (atomic_fetch_sub(&batch->remaining, 1) == 1) {
+    pthread_mutex_lock(&batch->lock);
+    pthread_cond_broadcast(&batch->done);
+    pthread_mutex_unlock(&batch->lock);
+  }
+}
+
+static void *worker_main(void *arg) {
+  int self = (int)(intptr_t)arg;
+  Task task;
+
+  while (1) {
+    if (find_task(self, &task)) {
+      run_task(&task);
+      continue;
+    }
+
+    pthread_mutex_lock(&idle_lock);
+    while (atomic_load(&queued) == 0 && !stopping) {
+      pthread_cond_wait(&work_available, &idle_lock);
+    }
+    bool done = stopping && atomic_load(&queued) == 0;
+    pthread_mutex_unlock(&idle_lock);
+    if (done) {
+      return NULL;
+    }
+  }
+}
+
+static void stop_workers(void) {
+  int workers = atomic_load(&worker_count);
+  if (workers == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&idle_lock);
+  stopping = true;
+  pthread_cond_broadcast(&work_available);
+  pthread_mutex_unlock(&idle_lock);
+
+  /* Every worker may still steal from any deque until it has exited */
+  for (int i = 0; i < workers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_destroy(&deques[i].lock);
+  }
+  atomic_store(&worker_count, 0);
+}
+
+static ErrorCode start_workers(int workers) {
+  stop_workers();
+
+  if (workers <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cpus > 0 ? (int)cpus : 1;
+  }
+  if (workers > POOL_MAX_WORKERS) {
+    workers = POOL_MAX_WORKERS;
+  }
+
+  pthread_mutex_lock(&idle_lock);
+  stopping = false;
+  pthread_mutex_unlock(&idle_lock);
+  for (int i = 0; i < workers; i++) {
+    pthread_mutex_init(&deques[i].lock, NULL);
+    deques[i].head = deques[i].tail = 0;
+  }
+  for (int i = 0; i < workers; i++) {
+    if (pthread_create(&threads[i], NULL, worker_main, (void *)(intptr_t)i) !=
+        0) {
+      atomic_store(&worker_count, i);
+      stop_workers();
+      return ERROR_INVALID_INPUT;
+    }
+    atomic_store(&worker_count, i + 1);
+  }
+  return SUCCESS;
+}
+
+void pool_configure(int workers) {
+  pthread_mutex_lock(&start_lock);
+  requested_workers = workers;
+  start_failed = false;
+  pthread_mutex_unlock(&start_lock);
+}
+
+ErrorCode pool_start(int workers) {
+  pthread_mutex_lock(&start_lock);
+  requested_workers = workers;
+  ErrorCode result = start_workers(workers);
+  start_failed = result != SUCCESS;
+  pthread_mutex_unlock(&start_lock);
+  return result;
+}
+
+void pool_stop(void) {
+  pthread_mutex_lock(&start_lock);
+  stop_workers();
+  pthread_mutex_unlock(&start_lock);
+}
+
+int pool_worker_count(void) { return atomic_load(&worker_count); }
+
+/* Starts the configured pool on first use; false if it cannot run */
+static bool pool_ensure(void) {
+  if (atomic_load(&worker_count) > 0) {
+    return true;
+  }
+  pthread_mutex_lock(&start_lock);
+  if (atomic_load(&worker_count) == 0 && !start_failed) {
+    start_failed = start_workers(requested_workers) != SUCCESS;
+  }
+  pthread_mutex_unlock(&start_lock);
+  return atomic_load(&worker_count) > 0;
+}
+
+void pool_run(TaskFunction *functions, void **args, int count) {
+  if (count <= 1 || !pool_ensure()) {
+    for (int i = 0; i < count; i++) {
+      functions[i](args[i]);
+    }
+    return;
+  }
+
+  Batch batch;
+  atomic_init(&batch.remaining, count);
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.done, NULL);
+
+  for (int i = 0; i < count; i++) {
+    Task task = {functions[i], args[i], &batch};
+    atomic_fetch_add(&queued, 1);
+    if (!deque_push(&deques[i % atomic_load(&worker_count)], task)) {
+      run_task(&task); /* deque full: run it here */
+    }
+  }
+
+  pthread_mutex_lock(&idle_lock);
+  pthread_cond_broadcast(&work_available);
+  pthread_mutex_unlock(&idle_lock);
+
+  /* Help out instead of sleeping while tasks are still queued */
+  Task task;
+  while (atomic_load(&batch.remaining) > 0 && find_task(-1, &task)) {
+    run_task(&task);
+  }
+
+  pthread_mutex_lock(&batch.lock);
+  while (atomic_load(&batch.remaining) > 0) {
+    pthread_cond_wait(&batch.done, &batch.lock);
+  }
+  pthread_mutex_unlock(&batch.lock);
+
+  pthread_cond_destroy(&batch.done);
+  pthread_mutex_destroy(&batch.lock);
+}
+
+/*
+ * Parallel scan: the index range is cut into chunks, each chunk evaluates
+ * the predicate over its slice and records matches in its own region of a
+ * scratch array, and the regions are concatenated in chunk order so the
+ * result is identical to a sequential scan.
+ */
+
+typedef struct {
+  int begin;
+  int end;
+  int found;
+  int *out;
+  ScanPredicate predicate;
+  void *context;
+} ScanChunk;
+
+static void scan_chunk(void *arg) {
+  ScanChunk *chunk = arg;
+  for (int i = chunk->begin; i < chunk->end; i++) {
+    if (chunk->predicate(i, chunk->context)) {
+      chunk->out[chunk->found++] = i;
+    }
+  }
+}
+
+void parallel_set_threshold(int records) {
+  scan_threshold = records < 1 ? 1 : records;
+}
+
+int parallel_get_threshold(void) { return scan_threshold; }
+
+int parallel_scan(int count, ScanPredicate predicate, void *context,
+                  int *matches) {
+  int found = 0;
+
+  if (count < scan_threshold || !pool_ensure()) {
+    for (int i = 0; i < count; i++) {
+      if (predicate(i, context)) {
+        matches[found++] = i;
+      }
+    }
+    return found;
+  }
+
+  /* About four chunks per worker so stealing can balance the load */
+  int chunk_size = count / (atomic_load(&worker_count) * 4);
+  if (chunk_size < PARALLEL_MIN_CHUNK) {
+    chunk_size = PARALLEL_MIN_CHUNK;
+  }
+  int chunk_count = (count + chunk_size - 1) / chunk_size;
+
+  ScanChunk *chunks = malloc(sizeof(ScanChunk) * (size_t)chunk_count);
+  TaskFunction *functions = malloc(sizeof(TaskFunction) * (size_t)chunk_count);
+  void **args = malloc(sizeof(void *) * (size_t)chunk_count);
+  int *scratch = malloc(sizeof(int) * (size_t)count);
+  if (chunks == NULL || functions == NULL || args == NULL || scratch == NULL) {
+    free(chunks);
+    free(functions);
+    free(args);
+    free(scratch);
+    for (int i = 0; i < count; i++) {
+      if (predicate(i, context)) {
+        matches[found++] = i;
+      }
+    }
+    return found;
+  }
+
+  for (int c = 0; c < chunk_count; c++) {
+    chunks[c].begin = c * chunk_size;
+    chunks[c].end = chunks[c].begin + chunk_size < count
+                        ? chunks[c].begin + chunk_size
+                        : count;
+    chunks[c].found = 0;
+    chunks[c].out = scratch + chunks[c].begin;
+    chunks[c].predicate = predicate;
+    chunks[c].context = context;
+    functions[c] = scan_chunk;
+    args[c] = &chunks[c];
+  }
+
+  pool_run(functions, args, chunk_count);
+
+  for (int c = 0; c < chunk_count; c++) {
+    memcpy(matches + found, chunks[c].out,
+           sizeof(int) * (size_t)chunks[c].found);
+    found += chunks[c].found;
+  }
+
+  free(scratch);
+  free(args);
+  free(functions);
+  free(chunks);
+  return found;
+}
@@ -0,0 +1,36 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "../Utils/utils.h"
+
+/*
+ * The default threshold is far above MAX_BOOKS and MAX_USERS, so at the
+ * current catalog size every desk search and report scans inline and the
+ * pool is never started. LIBRARY_PARALLEL_THRESHOLD lowers it; make bench
+ * measures parallel_scan at 1, 2, 4 and all CPUs on a synthetic range.
+ */
+
+/* Parallel Scan Constants */
+#define POOL_MAX_WORKERS 16
+#define POOL_QUEUE_SIZE 256
+#define PARALLEL_SCAN_THRESHOLD 4096 /* default minimum records */
+#define PARALLEL_MIN_CHUNK 256
+
+/* Type Definitions */
+typedef void (*TaskFunction)(void *arg);
+typedef bool (*ScanPredicate)(int index, void *context);
+
+/* Thread Pool Functions */
+void pool_configure(int workers);
+ErrorCode pool_start(int workers);
+void pool_stop(void);
+int pool_worker_count(void);
+void pool_run(TaskFunction *functions, void **args, int count);
+
+/* Parallel Scan Functions */
+void parallel_set_threshold(int records);
+int parallel_get_threshold(void);
+int parallel_scan(int count, ScanPredicate predicate, void *context,
+                  int *matches);
+
+#endif /* PARALLEL_H */
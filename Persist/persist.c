@@ -0,0 +1,155 @@
+#include "persist.h"
+
+#include <pthread.h>
+
+/*
+ * Saves run on a background thread over a double-buffered copy of the
+ * library. persist_submit() copies the caller's state into the pending
+ * slot and returns; the writer swaps slots and saves the copy it took while
+ * the caller keeps mutating its own library. Submissions that arrive while
+ * a save is in progress overwrite the same pending slot, so bursts of
+ * mutations coalesce into a single write of the newest state.
+ *
+ * Dirty bits travel with the copy: submitting hands them to the writer and
+ * clears them in the caller, a coalesced submission inherits the bits of
+ * the copy it replaces, and a failed save hands its bits to the next one,
+ * even if that one was submitted while the failed save was running.
+ *
+ * A failure stays recorded until persist_flush() or persist_stop() reports
+ * it, so it is not hidden by a later save that succeeded.
+ */
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+static bool running = false;
+static bool stopping = false;
+
+static char data_file[256] = FILENAME;
+static Library slots[2];
+static int pending_slot = 0;
+static bool has_pending = false;
+static unsigned long submitted_seq = 0;
+static unsigned long written_seq = 0;
+static ErrorCode last_error = SUCCESS; /* first failure not yet reported */
+static Library carry; /* only the dirty bitmaps are used */
+
+static void merge_dirty(Library *into, const Library *from) {
+  for (int i = 0; i < BOOK_DIRTY_WORDS; i++) {
+    into->book_dirty[i] |= from->book_dirty[i];
+  }
+  for (int i = 0; i < USER_DIRTY_WORDS; i++) {
+    into->user_dirty[i] |= from->user_dirty[i];
+  }
+}
+
+static void *writer_main(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&lock);
+
+  while (1) {
+    while (!has_pending && !stopping) {
+      pthread_cond_wait(&work_ready, &lock);
+    }
+    if (!has_pending && stopping) {
+      break;
+    }
+
+    int slot = pending_slot;
+    unsigned long seq = submitted_seq;
+    pending_slot ^= 1;
+    has_pending = false;
+    pthread_mutex_unlock(&lock);
+
+    ErrorCode result = save_library_to_file(&slots[slot], data_file);
+
+    pthread_mutex_lock(&lock);
+    if (result != SUCCESS) {
+      /* The newer copy was taken before this merge, so give it the bits */
+      merge_dirty(has_pending ? &slots[pending_slot] : &carry, &slots[slot]);
+      if (last_error == SUCCESS) {
+        last_error = result;
+      }
+    }
+    written_seq = seq;
+    pthread_cond_broadcast(&work_done);
+  }
+
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+ErrorCode persist_start(const char *filename) {
+  if (running) {
+    return SUCCESS;
+  }
+
+  strncpy(data_file, filename, sizeof(data_file) - 1);
+  data_file[sizeof(data_file) - 1] = '\0';
+  stopping = false;
+  if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+    return ERROR_FILE_IO;
+  }
+  running = true;
+  return SUCCESS;
+}
+
+void persist_submit(Library *lib) {
+  if (!running) {
+    /* No writer thread: fall back to a synchronous save */
+    ErrorCode result = save_library_to_file(lib, data_file);
+    if (last_error == SUCCESS) {
+      last_error = result;
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&lock);
+  Library *pending = &slots[pending_slot];
+  if (has_pending) {
+    merge_dirty(&carry, pending);
+  }
+  *pending = *lib;
+  merge_dirty(pending, &carry);
+  clear_dirty(&carry);
+  clear_dirty(lib);
+  has_pending = true;
+  submitted_seq++;
+  pthread_cond_signal(&work_ready);
+  pthread_mutex_unlock(&lock);
+}
+
+ErrorCode persist_flush(void) {
+  if (!running) {
+    ErrorCode result = last_error;
+    last_error = SUCCESS;
+    return result;
+  }
+
+  pthread_mutex_lock(&lock);
+  while (written_seq != submitted_seq) {
+    pthread_cond_wait(&work_done, &lock);
+  }
+  ErrorCode result = last_error;
+  last_error = SUCCESS;
+  pthread_mutex_unlock(&lock);
+  return result;
+}
+
+ErrorCode persist_stop(void) {
+  if (!running) {
+    return persist_flush();
+  }
+
+  ErrorCode result = persist_flush();
+
+  pthread_mutex_lock(&lock);
+  stopping = true;
+  pthread_cond_signal(&work_ready);
+  pthread_mutex_unlock(&lock);
+
+  pthread_join(writer, NULL);
+  running = false;
+  return result;
+}
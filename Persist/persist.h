@@ -0,0 +1,12 @@
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include "../Utils/utils.h"
+
+/* Background Persistence Functions */
+ErrorCode persist_start(const char *filename);
+void persist_submit(Library *lib);
+ErrorCode persist_flush(void);
+ErrorCode persist_stop(void);
+
+#endif /* PERSIST_H */
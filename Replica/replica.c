@@ -0,0 +1,642 @@
+#include "../Utils/utils.h"
+#include "replica.h"
+#include "../Storage/snapshot.h"
+#include "../Trace/trace.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Log-shipping replication over a Unix domain socket.
+ *
+ * The primary taps the trace hooks: every mutating call is logged at entry
+ * with its arguments (and the borrow/return time), so a follower that
+ * applies the same calls in the same order on the same state reaches the
+ * same state, including calls that failed. Records go into an in-memory
+ * ring numbered by log sequence number (LSN). A follower that falls off
+ * the end of the ring, or has no state yet, is first sent a compressed
+ * snapshot of the last checkpoint together with its LSN.
+ *
+ * Frames are a type byte, a u32 payload length and the payload:
+ *   'C' follower hello:  varint primary id, varint applied LSN + 1 (0=none)
+ *   'S' snapshot:        varint primary id, varint LSN, .lbz image
+ *   'R' record:          varint LSN, encoded trace record
+ *   'H' heartbeat:       varint primary LSN
+ */
+
+#define FRAME_HEADER_SIZE 5
+#define MAX_FRAME_SIZE (64u * 1024 * 1024)
+#define RECORDS_PER_WAKEUP 64
+
+/* Socket Helpers */
+
+static bool send_all(int fd, const unsigned char *data, size_t size) {
+  while (size > 0) {
+    ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    data += sent;
+    size -= (size_t)sent;
+  }
+  return true;
+}
+
+static bool recv_all(int fd, unsigned char *data, size_t size,
+                     int timeout_ms) {
+  while (size > 0) {
+    struct pollfd waiting = {.fd = fd, .events = POLLIN};
+    int ready = poll(&waiting, 1, timeout_ms);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready <= 0) {
+      return false;
+    }
+    ssize_t got = recv(fd, data, size, 0);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    data += got;
+    size -= (size_t)got;
+  }
+  return true;
+}
+
+static bool send_frame(int fd, char type, const ByteBuffer *payload) {
+  ByteBuffer header;
+  buffer_init(&header);
+  buffer_put_u8(&header, (unsigned char)type);
+  buffer_put_u32(&header, (uint32_t)payload->size);
+  bool ok = !header.failed && !payload->failed &&
+            send_all(fd, header.data, header.size) &&
+            send_all(fd, payload->data, payload->size);
+  buffer_free(&header);
+  return ok;
+}
+
+/* Reads one frame; the caller frees *payload */
+static bool recv_frame(int fd, char *type, unsigned char **payload,
+                       size_t *size) {
+  unsigned char header[FRAME_HEADER_SIZE];
+  if (!recv_all(fd, header, sizeof(header), REPLICA_TIMEOUT_MS)) {
+    return false;
+  }
+  ByteReader in;
+  reader_init(&in, header, sizeof(header));
+  *type = (char)reader_u8(&in);
+  uint32_t length = reader_u32(&in);
+  if (length > MAX_FRAME_SIZE) {
+    return false;
+  }
+
+  *payload = malloc(length > 0 ? length : 1);
+  if (*payload == NULL) {
+    return false;
+  }
+  if (!recv_all(fd, *payload, length, REPLICA_TIMEOUT_MS)) {
+    free(*payload);
+    return false;
+  }
+  *size = length;
+  return true;
+}
+
+static void make_address(struct sockaddr_un *address, const char *path) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  strncpy(address->sun_path, path, sizeof(address->sun_path) - 1);
+}
+
+static struct timespec deadline_after_ms(int ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += ms / 1000;
+  deadline.tv_nsec += (long)(ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  return deadline;
+}
+
+/* Primary Side */
+
+typedef struct {
+  int fd;
+  pthread_t thread;
+  atomic_bool done;
+} Follower;
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_grew = PTHREAD_COND_INITIALIZER;
+static TraceRecord log_records[REPLICATION_LOG_SIZE];
+static uint64_t last_lsn;
+static Library *checkpoint;
+static uint64_t checkpoint_lsn;
+static uint64_t primary_id;
+static bool primary_stopping;
+
+static int listen_fd = -1;
+static pthread_t acceptor;
+static Follower followers[MAX_FOLLOWERS];
+static bool follower_used[MAX_FOLLOWERS];
+
+/* Runs under the trace lock, so records arrive in call order */
+static void replication_sink(const TraceRecord *record) {
+  if (record->op == TRACE_SEARCH) {
+    return; /* reads do not change state */
+  }
+  pthread_mutex_lock(&log_lock);
+  last_lsn++;
+  log_records[last_lsn % REPLICATION_LOG_SIZE] = *record;
+  pthread_cond_broadcast(&log_grew);
+  pthread_mutex_unlock(&log_lock);
+}
+
+/* Called by the writer between operations, so the copy is consistent */
+void replica_checkpoint(const Library *lib) {
+  pthread_mutex_lock(&log_lock);
+  if (checkpoint != NULL) {
+    *checkpoint = *lib;
+    checkpoint_lsn = last_lsn;
+  }
+  pthread_mutex_unlock(&log_lock);
+}
+
+static uint64_t oldest_logged_lsn(void) {
+  return last_lsn >= REPLICATION_LOG_SIZE ? last_lsn - REPLICATION_LOG_SIZE + 1
+                                          : 1;
+}
+
+/* Copies the checkpoint out under log_lock; encodes it without the lock */
+static bool send_snapshot(int fd, uint64_t *next) {
+  Library *copy = malloc(sizeof(Library));
+  if (copy == NULL) {
+    return false;
+  }
+  *copy = *checkpoint;
+  uint64_t lsn = checkpoint_lsn;
+  pthread_mutex_unlock(&log_lock);
+
+  ByteBuffer image, payload;
+  buffer_init(&image);
+  buffer_init(&payload);
+  bool ok = encode_compressed_library(copy, &image) == SUCCESS;
+  free(copy);
+  if (ok) {
+    buffer_put_varint(&payload, primary_id);
+    buffer_put_varint(&payload, lsn);
+    buffer_put_bytes(&payload, image.data, image.size);
+    ok = send_frame(fd, 'S', &payload);
+  }
+  buffer_free(&payload);
+  buffer_free(&image);
+
+  pthread_mutex_lock(&log_lock);
+  *next = lsn + 1;
+  return ok;
+}
+
+static bool send_records(int fd, uint64_t *next) {
+  TraceRecord batch[RECORDS_PER_WAKEUP];
+  uint64_t first = *next;
+  int count = 0;
+  while (count < RECORDS_PER_WAKEUP && first + (uint64_t)count <= last_lsn) {
+    batch[count] =
+        log_records[(first + (uint64_t)count) % REPLICATION_LOG_SIZE];
+    count++;
+  }
+  pthread_mutex_unlock(&log_lock);
+
+  ByteBuffer payload;
+  buffer_init(&payload);
+  bool ok = true;
+  for (int i = 0; ok && i < count; i++) {
+    payload.size = 0;
+    buffer_put_varint(&payload, first + (uint64_t)i);
+    encode_trace_record(&payload, &batch[i], batch[i].offset_us);
+    ok = send_frame(fd, 'R', &payload);
+  }
+  buffer_free(&payload);
+
+  pthread_mutex_lock(&log_lock);
+  *next = first + (uint64_t)count;
+  return ok;
+}
+
+static bool send_heartbeat(int fd) {
+  uint64_t lsn = last_lsn;
+  pthread_mutex_unlock(&log_lock);
+  ByteBuffer payload;
+  buffer_init(&payload);
+  buffer_put_varint(&payload, lsn);
+  bool ok = send_frame(fd, 'H', &payload);
+  buffer_free(&payload);
+  pthread_mutex_lock(&log_lock);
+  return ok;
+}
+
+static void *serve_follower(void *arg) {
+  Follower *follower = arg;
+  char type;
+  unsigned char *hello;
+  size_t size;
+
+  if (recv_frame(follower->fd, &type, &hello, &size)) {
+    ByteReader in;
+    reader_init(&in, hello, size);
+    uint64_t their_primary = reader_varint(&in);
+    uint64_t applied = reader_varint(&in);
+    bool valid = type == 'C' && !in.failed;
+    free(hello);
+
+    /* Resume only a follower that already holds state from this primary */
+    uint64_t next = valid && their_primary == primary_id && applied > 0
+                        ? applied
+                        : 0;
+    bool ok = valid;
+
+    pthread_mutex_lock(&log_lock);
+    while (ok && !primary_stopping) {
+      if (next == 0 || next < oldest_logged_lsn()) {
+        ok = send_snapshot(follower->fd, &next);
+        if (ok && next < oldest_logged_lsn()) {
+          /* The checkpoint lags the ring; wait for a newer one */
+          struct timespec deadline = deadline_after_ms(REPLICA_HEARTBEAT_MS);
+          pthread_cond_timedwait(&log_grew, &log_lock, &deadline);
+        }
+      } else if (next <= last_lsn) {
+        ok = send_records(follower->fd, &next);
+      } else {
+        struct timespec deadline = deadline_after_ms(REPLICA_HEARTBEAT_MS);
+        if (pthread_cond_timedwait(&log_grew, &log_lock, &deadline) ==
+                ETIMEDOUT &&
+            next > last_lsn) {
+          ok = send_heartbeat(follower->fd);
+        }
+      }
+    }
+    pthread_mutex_unlock(&log_lock);
+  }
+
+  close(follower->fd);
+  atomic_store(&follower->done, true);
+  return NULL;
+}
+
+/* Joins finished sessions so their slots can be reused */
+static void reap_followers(void) {
+  for (int i = 0; i < MAX_FOLLOWERS; i++) {
+    if (follower_used[i] && atomic_load(&followers[i].done)) {
+      pthread_join(followers[i].thread, NULL);
+      follower_used[i] = false;
+    }
+  }
+}
+
+static void *accept_followers(void *arg) {
+  (void)arg;
+  while (1) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      return NULL; /* listener shut down */
+    }
+
+    pthread_mutex_lock(&log_lock);
+    bool stopping = primary_stopping;
+    pthread_mutex_unlock(&log_lock);
+    reap_followers();
+
+    int slot = -1;
+    for (int i = 0; !stopping && i < MAX_FOLLOWERS && slot < 0; i++) {
+      if (!follower_used[i]) {
+        slot = i;
+      }
+    }
+    if (slot < 0) {
+      close(fd);
+      continue;
+    }
+
+    Follower *follower = &followers[slot];
+    follower->fd = fd;
+    atomic_store(&follower->done, false);
+    if (pthread_create(&follower->thread, NULL, serve_follower, follower) !=
+        0) {
+      close(fd);
+      continue;
+    }
+    follower_used[slot] = true;
+  }
+}
+
+ErrorCode replica_primary_start(const char *socket_path, const Library *lib) {
+  struct sockaddr_un address;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    return ERROR_INVALID_INPUT;
+  }
+
+  checkpoint = malloc(sizeof(Library));
+  if (checkpoint == NULL) {
+    return ERROR_FILE_IO;
+  }
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  make_address(&address, socket_path);
+  unlink(socket_path);
+  if (listen_fd < 0 ||
+      bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listen_fd, MAX_FOLLOWERS) != 0) {
+    if (listen_fd >= 0) {
+      close(listen_fd);
+      listen_fd = -1;
+    }
+    free(checkpoint);
+    checkpoint = NULL;
+    return ERROR_FILE_IO;
+  }
+
+  /* Distinguishes this run's LSNs from a previous run's */
+  primary_id = ((uint64_t)time(NULL) << 20) ^ (uint64_t)getpid();
+  last_lsn = 0;
+  primary_stopping = false;
+  replica_checkpoint(lib);
+
+  if (pthread_create(&acceptor, NULL, accept_followers, NULL) != 0) {
+    close(listen_fd);
+    listen_fd = -1;
+    free(checkpoint);
+    checkpoint = NULL;
+    return ERROR_FILE_IO;
+  }
+  trace_set_sink(replication_sink);
+  return SUCCESS;
+}
+
+void replica_primary_stop(void) {
+  if (listen_fd < 0) {
+    return;
+  }
+  trace_set_sink(NULL);
+
+  pthread_mutex_lock(&log_lock);
+  primary_stopping = true;
+  pthread_cond_broadcast(&log_grew);
+  pthread_mutex_unlock(&log_lock);
+
+  shutdown(listen_fd, SHUT_RDWR);
+  pthread_join(acceptor, NULL);
+  close(listen_fd);
+  listen_fd = -1;
+
+  for (int i = 0; i < MAX_FOLLOWERS; i++) {
+    if (follower_used[i]) {
+      shutdown(followers[i].fd, SHUT_RDWR);
+      pthread_join(followers[i].thread, NULL);
+      follower_used[i] = false;
+    }
+  }
+
+  pthread_mutex_lock(&log_lock);
+  free(checkpoint);
+  checkpoint = NULL;
+  pthread_mutex_unlock(&log_lock);
+}
+
+int replica_follower_count(void) {
+  int count = 0;
+  for (int i = 0; i < MAX_FOLLOWERS; i++) {
+    if (follower_used[i] && !atomic_load(&followers[i].done)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+/* Follower Side */
+
+static pthread_mutex_t status_lock = PTHREAD_MUTEX_INITIALIZER;
+static ReplicaStatus status;
+static uint64_t synced_primary_id; /* 0 = no state yet */
+static VersionedLibrary *replica_versions;
+static char follow_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static pthread_t receiver;
+static atomic_bool follow_stopping;
+static atomic_int follow_fd = -1;
+
+static void note_contact(uint64_t primary_lsn) {
+  pthread_mutex_lock(&status_lock);
+  status.last_contact = time(NULL);
+  if (primary_lsn > status.primary_lsn) {
+    status.primary_lsn = primary_lsn;
+  }
+  pthread_mutex_unlock(&status_lock);
+}
+
+static bool apply_snapshot(ByteReader *in) {
+  uint64_t id = reader_varint(in);
+  uint64_t lsn = reader_varint(in);
+  size_t size = (size_t)(in->end - in->cursor);
+  const unsigned char *image = reader_bytes(in, size);
+  if (in->failed) {
+    return false;
+  }
+
+  Library *next = write_begin(replica_versions);
+  if (next == NULL) {
+    return false;
+  }
+  init_library(next);
+  if (load_compressed_library(next, (const char *)image, size) != SUCCESS) {
+    write_abort(replica_versions, next);
+    return false;
+  }
+  write_commit(replica_versions, next);
+
+  pthread_mutex_lock(&status_lock);
+  synced_primary_id = id;
+  status.applied_lsn = lsn;
+  status.primary_lsn = lsn;
+  status.catch_ups++;
+  pthread_mutex_unlock(&status_lock);
+  note_contact(lsn);
+  return true;
+}
+
+static bool apply_record(ByteReader *in) {
+  uint64_t lsn = reader_varint(in);
+  TraceRecord record;
+  if (in->failed || !decode_trace_record(in, &record, 0)) {
+    return false;
+  }
+
+  pthread_mutex_lock(&status_lock);
+  bool in_order = synced_primary_id != 0 && lsn == status.applied_lsn + 1;
+  pthread_mutex_unlock(&status_lock);
+  if (!in_order) {
+    return false; /* reconnect and resynchronise */
+  }
+
+  /* A call that failed on the primary fails here too and changes nothing */
+  Library *next = write_begin(replica_versions);
+  if (next == NULL) {
+    return false;
+  }
+  if (apply_trace_record(next, &record) == SUCCESS) {
+    write_commit(replica_versions, next);
+  } else {
+    write_abort(replica_versions, next);
+  }
+
+  pthread_mutex_lock(&status_lock);
+  status.applied_lsn = lsn;
+  pthread_mutex_unlock(&status_lock);
+  note_contact(lsn);
+  return true;
+}
+
+static void follow_session(int fd) {
+  ByteBuffer hello;
+  buffer_init(&hello);
+  pthread_mutex_lock(&status_lock);
+  buffer_put_varint(&hello, synced_primary_id);
+  buffer_put_varint(&hello,
+                    synced_primary_id != 0 ? status.applied_lsn + 1 : 0);
+  pthread_mutex_unlock(&status_lock);
+  bool ok = send_frame(fd, 'C', &hello);
+  buffer_free(&hello);
+
+  while (ok && !atomic_load(&follow_stopping)) {
+    char type;
+    unsigned char *payload;
+    size_t size;
+    if (!recv_frame(fd, &type, &payload, &size)) {
+      break;
+    }
+
+    ByteReader in;
+    reader_init(&in, payload, size);
+    switch (type) {
+    case 'S':
+      ok = apply_snapshot(&in);
+      break;
+    case 'R':
+      ok = apply_record(&in);
+      break;
+    case 'H': {
+      uint64_t lsn = reader_varint(&in);
+      ok = !in.failed;
+      if (ok) {
+        note_contact(lsn);
+      }
+      break;
+    }
+    default:
+      ok = false;
+      break;
+    }
+    free(payload);
+  }
+}
+
+static void *receive_log(void *arg) {
+  (void)arg;
+  struct sockaddr_un address;
+  make_address(&address, follow_path);
+
+  while (!atomic_load(&follow_stopping)) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 &&
+        connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+      atomic_store(&follow_fd, fd);
+      pthread_mutex_lock(&status_lock);
+      status.connected = true;
+      pthread_mutex_unlock(&status_lock);
+
+      follow_session(fd);
+
+      pthread_mutex_lock(&status_lock);
+      status.connected = false;
+      pthread_mutex_unlock(&status_lock);
+      atomic_store(&follow_fd, -1);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+
+    /* Retry once a heartbeat period, waking early on shutdown */
+    for (int waited = 0; waited < REPLICA_HEARTBEAT_MS &&
+                         !atomic_load(&follow_stopping);
+         waited += 100) {
+      struct timespec pause = {0, 100 * 1000 * 1000};
+      nanosleep(&pause, NULL);
+    }
+  }
+  return NULL;
+}
+
+ErrorCode replica_follow_start(const char *socket_path,
+                               VersionedLibrary *versions) {
+  if (strlen(socket_path) >= sizeof(follow_path)) {
+    return ERROR_INVALID_INPUT;
+  }
+  strncpy(follow_path, socket_path, sizeof(follow_path) - 1);
+  replica_versions = versions;
+  memset(&status, 0, sizeof(status));
+  synced_primary_id = 0;
+  atomic_store(&follow_stopping, false);
+
+  if (pthread_create(&receiver, NULL, receive_log, NULL) != 0) {
+    return ERROR_FILE_IO;
+  }
+  return SUCCESS;
+}
+
+void replica_follow_stop(void) {
+  atomic_store(&follow_stopping, true);
+  int fd = atomic_load(&follow_fd);
+  if (fd >= 0) {
+    shutdown(fd, SHUT_RDWR);
+  }
+  pthread_join(receiver, NULL);
+}
+
+void replica_get_status(ReplicaStatus *out) {
+  pthread_mutex_lock(&status_lock);
+  *out = status;
+  pthread_mutex_unlock(&status_lock);
+}
+
+void display_replica_status(void) {
+  ReplicaStatus current;
+  replica_get_status(&current);
+
+  printf("\n=== Replication Status ===\n");
+  printf("Primary: %s (%s)\n", follow_path,
+         current.connected ? "connected" : "disconnected");
+  if (current.last_contact == 0) {
+    printf("No state received yet.\n");
+    return;
+  }
+  printf("Applied LSN: %llu\n", (unsigned long long)current.applied_lsn);
+  printf("Primary LSN: %llu\n", (unsigned long long)current.primary_lsn);
+  printf("Lag: %llu records, last contact %ld seconds ago\n",
+         (unsigned long long)(current.primary_lsn - current.applied_lsn),
+         (long)(time(NULL) - current.last_contact));
+  printf("Snapshots received: %lu\n", current.catch_ups);
+}
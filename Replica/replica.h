@@ -0,0 +1,37 @@
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include "../Utils/utils.h"
+#include "../Version/version.h"
+
+#include <stdint.h>
+
+/* Replication Constants */
+#define REPLICATION_LOG_SIZE 4096 /* records a follower may fall behind */
+#define REPLICA_HEARTBEAT_MS 1000
+#define REPLICA_TIMEOUT_MS 5000
+#define MAX_FOLLOWERS 8
+
+/* Type Definitions */
+typedef struct {
+  bool connected;
+  uint64_t applied_lsn;  /* last record applied locally */
+  uint64_t primary_lsn;  /* last record the primary has logged */
+  time_t last_contact;
+  unsigned long catch_ups; /* snapshots received */
+} ReplicaStatus;
+
+/* Primary Functions */
+ErrorCode replica_primary_start(const char *socket_path, const Library *lib);
+void replica_checkpoint(const Library *lib);
+void replica_primary_stop(void);
+int replica_follower_count(void);
+
+/* Follower Functions */
+ErrorCode replica_follow_start(const char *socket_path,
+                               VersionedLibrary *versions);
+void replica_follow_stop(void);
+void replica_get_status(ReplicaStatus *status);
+void display_replica_status(void);
+
+#endif /* REPLICA_H */
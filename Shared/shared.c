@@ -0,0 +1,518 @@
+#include "../Utils/utils.h"
+#include "shared.h"
+#include "../Cache/cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Several desk processes share one catalog through a POSIX shared-memory
+ * object holding the Library itself.
+ *
+ * Writers take a process-shared robust mutex, so one desk changes the
+ * catalog at a time and a desk that dies holding it does not wedge the
+ * others: the next locker gets EOWNERDEAD, puts back the copy of the
+ * library taken when the dead writer started, and marks the mutex
+ * consistent. A write in progress is flagged by an odd sequence number.
+ * Readers never lock: they copy the library and retry if the sequence
+ * was odd or moved meanwhile (a seqlock). Reports then run on the private
+ * copy, which a writer cannot change halfway through a listing.
+ *
+ * Generations are issued from the segment rather than per process, so a
+ * query cache entry in any desk can only match the version it was built
+ * from. One desk at a time holds the save lock and writes the data file
+ * whenever the change count moves; when it exits another desk takes over.
+ * Desks register their PID, and the last live desk to leave unlinks the
+ * object so the next start reloads from the saved file.
+ *
+ * Only the creator reads the data file, straight into the segment, while
+ * it holds a write lock on the object; joining desks never load it. A
+ * joiner that finds the object unfilled and the lock free is looking at a
+ * creator that died, so it unlinks the object and starts over.
+ */
+
+#define SHARED_OPEN_ATTEMPTS 10
+#define SHARED_ATTACH_WAIT_MS 5000
+#define SHARED_STALE_CHECKS 5 /* unlocked, unfilled polls before unlinking */
+
+static struct timespec deadline_after_ms(int ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += ms / 1000;
+  deadline.tv_nsec += (long)(ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  return deadline;
+}
+
+static void sleep_ms(int ms) {
+  struct timespec pause = {ms / 1000, (long)(ms % 1000) * 1000000L};
+  nanosleep(&pause, NULL);
+}
+
+/* Locking */
+
+static ErrorCode lock_segment(SharedSegment *segment) {
+  int result = pthread_mutex_lock(&segment->write_lock);
+  if (result == EOWNERDEAD) {
+    /* The last writer died; roll back to the version it started from */
+    if (atomic_load(&segment->sequence) & 1) {
+      segment->lib = segment->undo;
+      atomic_fetch_add_explicit(&segment->sequence, 1, memory_order_release);
+    }
+    segment->recoveries++;
+    pthread_mutex_consistent(&segment->write_lock);
+    result = 0;
+  }
+  return result == 0 ? SUCCESS : ERROR_FILE_IO;
+}
+
+static bool init_shared_mutex(pthread_mutex_t *mutex) {
+  pthread_mutexattr_t attr;
+  bool ok = pthread_mutexattr_init(&attr) == 0 &&
+            pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) == 0 &&
+            pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) == 0 &&
+            pthread_mutex_init(mutex, &attr) == 0;
+  pthread_mutexattr_destroy(&attr);
+  return ok;
+}
+
+/* Writers and Readers */
+
+Library *shared_write_begin(SharedLibrary *shared) {
+  SharedSegment *segment = shared->segment;
+  if (lock_segment(segment) != SUCCESS) {
+    return NULL;
+  }
+  segment->undo = segment->lib;
+  atomic_fetch_add_explicit(&segment->sequence, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  /* No generation is ever 0, so any library_touch() shows up as a change */
+  segment->lib.generation = 0;
+  return &segment->lib;
+}
+
+void shared_write_end(SharedLibrary *shared) {
+  SharedSegment *segment = shared->segment;
+  if (segment->lib.generation != 0) {
+    segment->lib.generation =
+        atomic_fetch_add(&segment->generation_source, 1) + 1;
+    atomic_fetch_add(&segment->change_count, 1);
+  } else {
+    segment->lib.generation = segment->undo.generation;
+  }
+  atomic_fetch_add_explicit(&segment->sequence, 1, memory_order_release);
+  pthread_mutex_unlock(&segment->write_lock);
+}
+
+void shared_read(SharedLibrary *shared, Library *copy) {
+  SharedSegment *segment = shared->segment;
+  for (int spin = 0; spin < SHARED_READ_SPINS; spin++) {
+    unsigned long before =
+        atomic_load_explicit(&segment->sequence, memory_order_acquire);
+    if ((before & 1) == 0) {
+      memcpy(copy, &segment->lib, sizeof(Library));
+      atomic_thread_fence(memory_order_acquire);
+      if (atomic_load_explicit(&segment->sequence, memory_order_relaxed) ==
+          before) {
+        return;
+      }
+    }
+    sched_yield();
+  }
+
+  /* Still odd: the writer may be dead, and locking repairs that */
+  if (lock_segment(segment) == SUCCESS) {
+    *copy = segment->lib;
+    pthread_mutex_unlock(&segment->write_lock);
+  }
+}
+
+/* Saving */
+
+/* Takes the dirty bits out under the write lock and saves without it */
+static void save_changes(SharedLibrary *shared) {
+  SharedSegment *segment = shared->segment;
+  if (atomic_load(&segment->change_count) ==
+      atomic_load(&segment->saved_count)) {
+    return;
+  }
+
+  Library *copy = malloc(sizeof(Library));
+  Library *lib = copy != NULL ? shared_write_begin(shared) : NULL;
+  if (lib == NULL) {
+    free(copy);
+    shared->last_error = ERROR_FILE_IO;
+    return;
+  }
+  unsigned long changes = atomic_load(&segment->change_count);
+  *copy = *lib;
+  copy->generation = segment->undo.generation;
+  clear_dirty(lib);
+  shared_write_end(shared);
+
+  ErrorCode result = save_library_to_file(copy, shared->filename);
+  if (result == SUCCESS) {
+    atomic_store(&segment->saved_count, changes);
+  } else if ((lib = shared_write_begin(shared)) != NULL) {
+    mark_all_dirty(lib); /* the next attempt rewrites everything */
+    shared_write_end(shared);
+  }
+  shared->last_error = result;
+  free(copy);
+}
+
+static void *saver_main(void *arg) {
+  SharedLibrary *shared = arg;
+  SharedSegment *segment = shared->segment;
+
+  while (!atomic_load(&shared->stopping)) {
+    if (!atomic_load(&shared->saving)) {
+      struct timespec deadline = deadline_after_ms(SHARED_SAVE_POLL_MS);
+      int result = pthread_mutex_timedlock(&segment->save_lock, &deadline);
+      if (result == EOWNERDEAD) {
+        pthread_mutex_consistent(&segment->save_lock);
+        result = 0;
+      }
+      atomic_store(&shared->saving, result == 0);
+      continue;
+    }
+    save_changes(shared);
+    sleep_ms(SHARED_SAVE_POLL_MS);
+  }
+
+  /* Leave nothing unsaved behind unless another desk is saving */
+  if (!atomic_load(&shared->saving)) {
+    int result = pthread_mutex_trylock(&segment->save_lock);
+    if (result == EOWNERDEAD) {
+      pthread_mutex_consistent(&segment->save_lock);
+      result = 0;
+    }
+    atomic_store(&shared->saving, result == 0);
+  }
+  if (atomic_load(&shared->saving)) {
+    save_changes(shared);
+    pthread_mutex_unlock(&segment->save_lock);
+    atomic_store(&shared->saving, false);
+  }
+  return NULL;
+}
+
+/* Attach/Detach */
+
+/* Frees the slots of desks that exited without detaching; under the lock */
+static int count_live_desks(SharedSegment *segment) {
+  int live = 0;
+  for (int i = 0; i < SHARED_MAX_DESKS; i++) {
+    pid_t pid = segment->desks[i];
+    if (pid != 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+      segment->desks[i] = 0;
+    } else if (pid != 0) {
+      live++;
+    }
+  }
+  return live;
+}
+
+static bool attach_desk(SharedSegment *segment) {
+  count_live_desks(segment);
+  for (int i = 0; i < SHARED_MAX_DESKS; i++) {
+    if (segment->desks[i] == 0) {
+      segment->desks[i] = getpid();
+      return true;
+    }
+  }
+  return false;
+}
+
+static void detach_desk(SharedSegment *segment) {
+  pid_t self = getpid();
+  for (int i = 0; i < SHARED_MAX_DESKS; i++) {
+    if (segment->desks[i] == self) {
+      segment->desks[i] = 0;
+      break;
+    }
+  }
+}
+
+static ErrorCode init_segment(SharedLibrary *shared, SharedSegment *segment) {
+  if (!init_shared_mutex(&segment->write_lock) ||
+      !init_shared_mutex(&segment->save_lock)) {
+    return ERROR_FILE_IO;
+  }
+  segment->layout_size = (uint32_t)sizeof(SharedSegment);
+  init_library(&segment->lib);
+  shared->load_result = load_library_from_file(&segment->lib, shared->filename);
+  if (shared->load_result == ERROR_CORRUPT_FILE) {
+    return ERROR_CORRUPT_FILE; /* nobody may share, and save over, it */
+  }
+  if (shared->load_result != SUCCESS) {
+    init_library(&segment->lib);
+  }
+  segment->lib.generation =
+      atomic_fetch_add(&segment->generation_source, 1) + 1;
+  atomic_store(&segment->change_count, 1); /* first saver writes it out */
+  atomic_store_explicit(&segment->magic, SHARED_MAGIC, memory_order_release);
+  return SUCCESS;
+}
+
+/* The creator keeps a write lock on the object until the magic is stored;
+ * fcntl locks go away with the process that held them */
+static bool lock_object(int fd, int command) {
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  return fcntl(fd, command, &lock) == 0;
+}
+
+static void unlock_object(int fd) {
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = F_UNLCK;
+  lock.l_whence = SEEK_SET;
+  fcntl(fd, F_SETLK, &lock);
+}
+
+/* Maps the object once the creator has sized it; NULL until then */
+static ErrorCode map_filled(int fd, SharedSegment **segment) {
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    return ERROR_FILE_IO;
+  }
+  if (info.st_size == 0) {
+    return SUCCESS;
+  }
+  if (info.st_size < (off_t)sizeof(SharedSegment)) {
+    return ERROR_INVALID_INPUT; /* another build's layout */
+  }
+  if (*segment == NULL) {
+    void *mapped = mmap(NULL, sizeof(SharedSegment), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+      return ERROR_FILE_IO;
+    }
+    *segment = mapped;
+  }
+  return SUCCESS;
+}
+
+static bool segment_filled(const SharedSegment *segment) {
+  return segment != NULL &&
+         atomic_load_explicit(&segment->magic, memory_order_acquire) ==
+             SHARED_MAGIC;
+}
+
+/* The creator sizes, then fills the object; wait for both, or find it dead */
+static ErrorCode wait_for_creator(int fd, SharedSegment **mapped, bool *stale) {
+  SharedSegment *segment = NULL;
+  ErrorCode result = ERROR_FILE_IO;
+  int unlocked = 0;
+
+  for (int waited = 0; waited < SHARED_ATTACH_WAIT_MS; waited += 10) {
+    ErrorCode mapping = map_filled(fd, &segment);
+    if (mapping != SUCCESS) {
+      result = mapping;
+      break;
+    }
+    if (segment_filled(segment)) {
+      if (segment->layout_size != sizeof(SharedSegment)) {
+        result = ERROR_INVALID_INPUT;
+        break;
+      }
+      *mapped = segment;
+      return SUCCESS;
+    }
+
+    /* A live creator takes the lock right after creating the object, so
+     * only a few polls in a row can find it free by chance */
+    if (lock_object(fd, F_SETLK)) {
+      unlock_object(fd);
+      if (++unlocked >= SHARED_STALE_CHECKS) {
+        *stale = true;
+        break;
+      }
+    } else {
+      unlocked = 0;
+    }
+    sleep_ms(10);
+  }
+
+  if (segment != NULL) {
+    munmap(segment, sizeof(SharedSegment));
+  }
+  return result;
+}
+
+/* Unlinks the name only while it still refers to the abandoned object and
+ * that is still unfilled; racing joiners take turns under the lock */
+static void remove_stale_object(const char *name, int fd) {
+  if (!lock_object(fd, F_SETLKW)) {
+    return;
+  }
+  SharedSegment *segment = NULL;
+  bool filled =
+      map_filled(fd, &segment) == SUCCESS && segment_filled(segment);
+  if (segment != NULL) {
+    munmap(segment, sizeof(SharedSegment));
+  }
+
+  struct stat stale, current;
+  int current_fd = shm_open(name, O_RDWR, 0600);
+  if (!filled && current_fd >= 0 && fstat(fd, &stale) == 0 &&
+      fstat(current_fd, &current) == 0 && stale.st_dev == current.st_dev &&
+      stale.st_ino == current.st_ino) {
+    shm_unlink(name);
+  }
+  /* Closing either descriptor drops this process's lock */
+  if (current_fd >= 0) {
+    close(current_fd);
+  }
+}
+
+static ErrorCode map_segment(SharedLibrary *shared, bool *retry) {
+  bool created = true;
+  int fd = shm_open(shared->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    created = false;
+    fd = shm_open(shared->name, O_RDWR, 0600);
+  }
+  if (fd < 0) {
+    *retry = errno == ENOENT; /* unlinked between the two opens */
+    return ERROR_FILE_IO;
+  }
+
+  ErrorCode result = SUCCESS;
+  SharedSegment *segment = NULL;
+  if (created) {
+    segment = lock_object(fd, F_SETLKW) &&
+                      ftruncate(fd, sizeof(SharedSegment)) == 0
+                  ? mmap(NULL, sizeof(SharedSegment), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0)
+                  : MAP_FAILED;
+    if (segment == MAP_FAILED) {
+      segment = NULL;
+      result = ERROR_FILE_IO;
+    } else {
+      result = init_segment(shared, segment);
+    }
+    if (result != SUCCESS) {
+      if (segment != NULL) {
+        munmap(segment, sizeof(SharedSegment));
+      }
+      shm_unlink(shared->name);
+    }
+  } else {
+    bool stale = false;
+    result = wait_for_creator(fd, &segment, &stale);
+    if (stale) {
+      remove_stale_object(shared->name, fd);
+      *retry = true;
+    }
+  }
+  close(fd); /* also releases the creator's lock */
+
+  if (result == SUCCESS) {
+    shared->segment = segment;
+    shared->created = created;
+  }
+  return result;
+}
+
+ErrorCode shared_library_open(SharedLibrary *shared, const char *name,
+                              const char *filename) {
+  memset(shared, 0, sizeof(*shared));
+  /* shm names are "/name" */
+  snprintf(shared->name, sizeof(shared->name), "%s%s",
+           name[0] == '/' ? "" : "/", name);
+  strncpy(shared->filename, filename, sizeof(shared->filename) - 1);
+  shared->last_error = SUCCESS;
+  shared->load_result = SUCCESS;
+
+  for (int attempt = 0; attempt < SHARED_OPEN_ATTEMPTS; attempt++) {
+    bool retry = false;
+    ErrorCode result = map_segment(shared, &retry);
+    if (retry) {
+      continue;
+    }
+    if (result != SUCCESS) {
+      return result;
+    }
+
+    /* The last desk out unlinks; joining a dying segment means retrying */
+    SharedSegment *segment = shared->segment;
+    if (lock_segment(segment) != SUCCESS) {
+      munmap(segment, sizeof(SharedSegment));
+      return ERROR_FILE_IO;
+    }
+    bool unlinked = segment->unlinked;
+    bool attached = !unlinked && attach_desk(segment);
+    pthread_mutex_unlock(&segment->write_lock);
+    if (!attached) {
+      munmap(segment, sizeof(SharedSegment));
+      shared->segment = NULL;
+      if (unlinked) {
+        continue;
+      }
+      return ERROR_INVALID_INPUT; /* every desk slot is taken */
+    }
+
+    /* Entries cached before attaching used this process's generations */
+    query_cache_clear();
+    atomic_store(&shared->stopping, false);
+    if (pthread_create(&shared->saver, NULL, saver_main, shared) != 0) {
+      atomic_store(&shared->stopping, true);
+      shared_library_close(shared);
+      return ERROR_FILE_IO;
+    }
+    return SUCCESS;
+  }
+  return ERROR_FILE_IO;
+}
+
+ErrorCode shared_library_close(SharedLibrary *shared) {
+  SharedSegment *segment = shared->segment;
+  if (segment == NULL) {
+    return shared->last_error;
+  }
+  if (!atomic_exchange(&shared->stopping, true)) {
+    pthread_join(shared->saver, NULL);
+  }
+
+  if (lock_segment(segment) == SUCCESS) {
+    detach_desk(segment);
+    if (count_live_desks(segment) == 0) {
+      segment->unlinked = true;
+      shm_unlink(shared->name);
+    }
+    pthread_mutex_unlock(&segment->write_lock);
+  }
+  munmap(segment, sizeof(SharedSegment));
+  shared->segment = NULL;
+  return shared->last_error;
+}
+
+void display_shared_status(SharedLibrary *shared) {
+  SharedSegment *segment = shared->segment;
+  int desks = 0;
+  if (lock_segment(segment) == SUCCESS) {
+    desks = count_live_desks(segment);
+    pthread_mutex_unlock(&segment->write_lock);
+  }
+  printf("\nShared Catalog: %s\n", shared->name);
+  printf("  - Desks attached: %d\n", desks);
+  printf("  - Saving desk: %s\n",
+         atomic_load(&shared->saving) ? "this one" : "another");
+  printf("  - Unsaved changes: %lu\n",
+         atomic_load(&segment->change_count) -
+             atomic_load(&segment->saved_count));
+  printf("  - Writers recovered after a crash: %lu\n", segment->recoveries);
+}
@@ -0,0 +1,66 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include "../Utils/utils.h"
+#include "../Storage/storage.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Shared Segment Constants */
+#define SHARED_MAGIC 0x4C425348u /* "LBSH" */
+#define SHARED_SAVE_POLL_MS 200
+#define SHARED_READ_SPINS 1000 /* retries before a reader takes the lock */
+#define SHARED_MAX_DESKS 32
+
+/* Type Definitions */
+
+/*
+ * One POSIX shared-memory object per catalog. Library holds no pointers
+ * (fixed arrays, holds linked by index), so every process can map it at
+ * any address.
+ */
+typedef struct {
+  atomic_uint magic;          /* stored last by the creator */
+  uint32_t layout_size;       /* sizeof(SharedSegment) of the creator */
+  pthread_mutex_t write_lock; /* process-shared, robust */
+  pthread_mutex_t save_lock;  /* held by the process that saves */
+  atomic_ulong sequence;      /* seqlock: odd while lib is changing */
+  atomic_ulong generation_source;
+  atomic_ulong change_count;
+  atomic_ulong saved_count;
+  pid_t desks[SHARED_MAX_DESKS]; /* mapped in, 0 = free; under write_lock */
+  bool unlinked;              /* removed by the last desk to leave */
+  unsigned long recoveries;   /* writers that died holding the lock */
+  Library lib;
+  Library undo; /* lib as of write start, restored if the writer dies */
+} SharedSegment;
+
+typedef struct {
+  SharedSegment *segment;
+  char name[MAX_PATH_LENGTH];
+  char filename[MAX_PATH_LENGTH];
+  bool created;
+  ErrorCode load_result; /* of the data file, read only by the creator */
+  atomic_bool saving; /* this process holds save_lock */
+  pthread_t saver;
+  atomic_bool stopping;
+  ErrorCode last_error;
+} SharedLibrary;
+
+/* Shared Library Functions */
+ErrorCode shared_library_open(SharedLibrary *shared, const char *name,
+                              const char *filename);
+ErrorCode shared_library_close(SharedLibrary *shared);
+
+/* Writers: one at a time across all processes */
+Library *shared_write_begin(SharedLibrary *shared);
+void shared_write_end(SharedLibrary *shared);
+
+/* Readers: lock-free copy of a consistent version */
+void shared_read(SharedLibrary *shared, Library *copy);
+void display_shared_status(SharedLibrary *shared);
+
+#endif /* SHARED_H */
@@ -0,0 +1,309 @@
+#include "codec.h"
+
+/* Byte Buffer Functions */
+
+void buffer_init(ByteBuffer *buffer) {
+  buffer->data = NULL;
+  buffer->size = 0;
+  buffer->capacity = 0;
+  buffer->failed = false;
+}
+
+void buffer_free(ByteBuffer *buffer) {
+  free(buffer->data);
+  buffer_init(buffer);
+}
+
+static bool buffer_reserve(ByteBuffer *buffer, size_t extra) {
+  if (buffer->failed) {
+    return false;
+  }
+  if (buffer->size + extra <= buffer->capacity) {
+    return true;
+  }
+
+  size_t capacity = buffer->capacity == 0 ? 256 : buffer->capacity * 2;
+  while (capacity < buffer->size + extra) {
+    capacity *= 2;
+  }
+  unsigned char *data = realloc(buffer->data, capacity);
+  if (data == NULL) {
+    buffer->failed = true;
+    return false;
+  }
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return true;
+}
+
+void buffer_put_bytes(ByteBuffer *buffer, const void *data, size_t size) {
+  if (size > 0 && buffer_reserve(buffer, size)) {
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+  }
+}
+
+void buffer_put_u8(ByteBuffer *buffer, unsigned value) {
+  unsigned char byte = (unsigned char)value;
+  buffer_put_bytes(buffer, &byte, 1);
+}
+
+void buffer_put_u32(ByteBuffer *buffer, uint32_t value) {
+  unsigned char bytes[4] = {(unsigned char)value, (unsigned char)(value >> 8),
+                            (unsigned char)(value >> 16),
+                            (unsigned char)(value >> 24)};
+  buffer_put_bytes(buffer, bytes, 4);
+}
+
+void buffer_put_varint(ByteBuffer *buffer, uint64_t value) {
+  unsigned char bytes[10];
+  size_t length = 0;
+  while (value >= 0x80) {
+    bytes[length++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  bytes[length++] = (unsigned char)value;
+  buffer_put_bytes(buffer, bytes, length);
+}
+
+/* Zig-zag keeps small negative deltas (and NO_BORROWER) to one byte */
+void buffer_put_svarint(ByteBuffer *buffer, int64_t value) {
+  buffer_put_varint(buffer, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void buffer_put_string(ByteBuffer *buffer, const char *str) {
+  size_t length = strlen(str);
+  buffer_put_varint(buffer, length);
+  buffer_put_bytes(buffer, str, length);
+}
+
+/* Byte Reader Functions */
+
+void reader_init(ByteReader *reader, const void *data, size_t size) {
+  reader->cursor = data;
+  reader->end = reader->cursor + size;
+  reader->failed = false;
+}
+
+const unsigned char *reader_bytes(ByteReader *reader, size_t size) {
+  if (reader->failed || (size_t)(reader->end - reader->cursor) < size) {
+    reader->failed = true;
+    return NULL;
+  }
+  const unsigned char *bytes = reader->cursor;
+  reader->cursor += size;
+  return bytes;
+}
+
+unsigned reader_u8(ByteReader *reader) {
+  const unsigned char *byte = reader_bytes(reader, 1);
+  return byte == NULL ? 0 : *byte;
+}
+
+uint32_t reader_u32(ByteReader *reader) {
+  const unsigned char *b = reader_bytes(reader, 4);
+  if (b == NULL) {
+    return 0;
+  }
+  return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) |
+         ((uint32_t)b[3] << 24);
+}
+
+uint64_t reader_varint(ByteReader *reader) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    const unsigned char *byte = reader_bytes(reader, 1);
+    if (byte == NULL) {
+      return 0;
+    }
+    value |= (uint64_t)(*byte & 0x7F) << shift;
+    if ((*byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  reader->failed = true;
+  return 0;
+}
+
+int64_t reader_svarint(ByteReader *reader) {
+  uint64_t value = reader_varint(reader);
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+void reader_string(ByteReader *reader, char *out, size_t size) {
+  uint64_t length = reader_varint(reader);
+  const unsigned char *bytes = reader_bytes(reader, (size_t)length);
+  if (bytes == NULL || length >= size) {
+    reader->failed = true;
+    out[0] = '\0';
+    return;
+  }
+  memcpy(out, bytes, (size_t)length);
+  out[length] = '\0';
+}
+
+/*
+ * Block compression in the LZ4 block format: a token byte holds the literal
+ * run length (high nibble) and match length minus 4 (low nibble), each
+ * extended with 255-valued bytes, followed by the literals and a two-byte
+ * little-endian match offset. Matches are found greedily through a hash of
+ * the next four bytes. The final 5 bytes are always literals and no match
+ * starts in the last 12, as the format requires.
+ */
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MATCH_LIMIT 12
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+
+size_t lz_compress_bound(size_t size) { return size + size / 255 + 16; }
+
+static uint32_t lz_read32(const unsigned char *p) {
+  uint32_t value;
+  memcpy(&value, p, 4);
+  return value;
+}
+
+static unsigned lz_hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static unsigned char *lz_put_length(unsigned char *out, size_t length) {
+  while (length >= 255) {
+    *out++ = 255;
+    length -= 255;
+  }
+  *out++ = (unsigned char)length;
+  return out;
+}
+
+static unsigned char *lz_put_sequence(unsigned char *out,
+                                      const unsigned char *literals,
+                                      size_t literal_length, size_t offset,
+                                      size_t match_length) {
+  unsigned char *token = out++;
+  *token = (unsigned char)((literal_length >= 15 ? 15 : literal_length) << 4);
+  if (literal_length >= 15) {
+    out = lz_put_length(out, literal_length - 15);
+  }
+  memcpy(out, literals, literal_length);
+  out += literal_length;
+
+  if (match_length == 0) {
+    return out; /* last sequence: literals only */
+  }
+
+  *out++ = (unsigned char)offset;
+  *out++ = (unsigned char)(offset >> 8);
+  size_t extra = match_length - LZ_MIN_MATCH;
+  *token |= (unsigned char)(extra >= 15 ? 15 : extra);
+  if (extra >= 15) {
+    out = lz_put_length(out, extra - 15);
+  }
+  return out;
+}
+
+size_t lz_compress(const unsigned char *src, size_t size, unsigned char *dst) {
+  const unsigned char *anchor = src;
+  const unsigned char *end = src + size;
+  unsigned char *out = dst;
+
+  if (size > LZ_MATCH_LIMIT) {
+    const unsigned char *match_limit = end - LZ_MATCH_LIMIT;
+    const unsigned char *copy_limit = end - LZ_LAST_LITERALS;
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const unsigned char *p = src + 1;
+    while (p < match_limit) {
+      unsigned h = lz_hash(lz_read32(p));
+      const unsigned char *candidate = src + table[h];
+      table[h] = (uint32_t)(p - src);
+
+      if (candidate >= p || p - candidate > LZ_MAX_OFFSET ||
+          lz_read32(candidate) != lz_read32(p)) {
+        p++;
+        continue;
+      }
+
+      size_t length = LZ_MIN_MATCH;
+      while (p + length < copy_limit && candidate[length] == p[length]) {
+        length++;
+      }
+
+      out = lz_put_sequence(out, anchor, (size_t)(p - anchor),
+                            (size_t)(p - candidate), length);
+      p += length;
+      anchor = p;
+    }
+  }
+
+  return (size_t)(lz_put_sequence(out, anchor, (size_t)(end - anchor), 0, 0) -
+                  dst);
+}
+
+static bool lz_get_length(const unsigned char **in, const unsigned char *end,
+                          size_t *length) {
+  unsigned char byte;
+  do {
+    if (*in >= end) {
+      return false;
+    }
+    byte = *(*in)++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+bool lz_decompress(const unsigned char *src, size_t size, unsigned char *dst,
+                   size_t dst_size) {
+  const unsigned char *in = src;
+  const unsigned char *in_end = src + size;
+  unsigned char *out = dst;
+  unsigned char *out_end = dst + dst_size;
+
+  while (in < in_end) {
+    unsigned token = *in++;
+
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 && !lz_get_length(&in, in_end, &literal_length)) {
+      return false;
+    }
+    if ((size_t)(in_end - in) < literal_length ||
+        (size_t)(out_end - out) < literal_length) {
+      return false;
+    }
+    memcpy(out, in, literal_length);
+    in += literal_length;
+    out += literal_length;
+
+    if (in == in_end) {
+      break; /* the last sequence has no match */
+    }
+
+    if (in_end - in < 2) {
+      return false;
+    }
+    size_t offset = (size_t)in[0] | ((size_t)in[1] << 8);
+    in += 2;
+    size_t match_length = (token & 15);
+    if (match_length == 15 && !lz_get_length(&in, in_end, &match_length)) {
+      return false;
+    }
+    match_length += LZ_MIN_MATCH;
+
+    if (offset == 0 || offset > (size_t)(out - dst) ||
+        (size_t)(out_end - out) < match_length) {
+      return false;
+    }
+    /* Byte copy: matches may overlap their own output */
+    const unsigned char *match = out - offset;
+    for (size_t i = 0; i < match_length; i++) {
+      out[i] = match[i];
+    }
+    out += match_length;
+  }
+
+  return out == out_end;
+}
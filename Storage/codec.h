@@ -0,0 +1,47 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "../Utils/utils.h"
+
+#include <stdint.h>
+
+/* Type Definitions */
+typedef struct {
+  unsigned char *data;
+  size_t size;
+  size_t capacity;
+  bool failed;
+} ByteBuffer;
+
+typedef struct {
+  const unsigned char *cursor;
+  const unsigned char *end;
+  bool failed;
+} ByteReader;
+
+/* Byte Buffer Functions */
+void buffer_init(ByteBuffer *buffer);
+void buffer_free(ByteBuffer *buffer);
+void buffer_put_bytes(ByteBuffer *buffer, const void *data, size_t size);
+void buffer_put_u8(ByteBuffer *buffer, unsigned value);
+void buffer_put_u32(ByteBuffer *buffer, uint32_t value);
+void buffer_put_varint(ByteBuffer *buffer, uint64_t value);
+void buffer_put_svarint(ByteBuffer *buffer, int64_t value);
+void buffer_put_string(ByteBuffer *buffer, const char *str);
+
+/* Byte Reader Functions */
+void reader_init(ByteReader *reader, const void *data, size_t size);
+unsigned reader_u8(ByteReader *reader);
+uint32_t reader_u32(ByteReader *reader);
+uint64_t reader_varint(ByteReader *reader);
+int64_t reader_svarint(ByteReader *reader);
+void reader_string(ByteReader *reader, char *out, size_t size);
+const unsigned char *reader_bytes(ByteReader *reader, size_t size);
+
+/* Block Compression (LZ4 block format) */
+size_t lz_compress_bound(size_t size);
+size_t lz_compress(const unsigned char *src, size_t size, unsigned char *dst);
+bool lz_decompress(const unsigned char *src, size_t size, unsigned char *dst,
+                   size_t dst_size);
+
+#endif /* CODEC_H */
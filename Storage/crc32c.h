@@ -0,0 +1,10 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* CRC32C (Castagnoli) Functions */
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+
+#endif /* CRC32C_H */
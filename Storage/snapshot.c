@@ -0,0 +1,576 @@
+#include "snapshot.h"
+#include "codec.h"
+#include "crc32c.h"
+#include "storage.h"
+#include "../Analytics/analytics.h"
+#include "../Book/book.h"
+#include "../Hold/hold.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Compressed snapshot layout:
+ *
+ *   "LBZ1" | u32 block count | per block: u8 kind, u32 raw size,
+ *   u32 compressed size, u32 CRC32C of the compressed bytes | block data
+ *
+ * followed by the usual file checksum trailer. The 'M' block carries the
+ * metadata and the author and genre dictionaries; 'B' and 'U' blocks carry
+ * up to SNAPSHOT_BLOCK_RECORDS books or users each, with IDs and borrow
+ * dates delta/zig-zag varint encoded and authors and genres replaced by
+ * dictionary indices; hold queues and then the circulation statistics
+ * follow the dictionaries in the 'M' block. Blocks are LZ-compressed independently, so after
+ * the dictionary block they are verified and decoded on several threads.
+ */
+
+#define BLOCK_META 'M'
+#define BLOCK_BOOKS 'B'
+#define BLOCK_USERS 'U'
+#define BLOCK_HEADER_SIZE 13
+#define DICTIONARY_SLOTS 256 /* power of two above MAX_BOOKS */
+#define MAX_BLOCKS                                                             \
+  (1 + (MAX_BOOKS + SNAPSHOT_BLOCK_RECORDS - 1) / SNAPSHOT_BLOCK_RECORDS +     \
+   (MAX_USERS + SNAPSHOT_BLOCK_RECORDS - 1) / SNAPSHOT_BLOCK_RECORDS)
+
+typedef struct {
+  const char *strings[MAX_BOOKS];
+  int count;
+  int slots[DICTIONARY_SLOTS]; /* index + 1, 0 when empty */
+} Dictionary;
+
+typedef struct {
+  char kind;
+  uint32_t raw_size;
+  uint32_t compressed_size;
+  uint32_t crc;
+  const unsigned char *data;
+} BlockInfo;
+
+typedef struct {
+  Library *lib;
+  BlockInfo blocks[MAX_BLOCKS];
+  int block_count;
+  char (*authors)[MAX_AUTHOR_LENGTH];
+  char (*genres)[MAX_GENRE_LENGTH];
+  int author_count;
+  int genre_count;
+  HoldEntry holds[MAX_HOLDS]; /* linked in once the books are decoded */
+  int hold_count;
+  CirculationStats circulation;
+  atomic_int next_block;
+  atomic_int books_decoded;
+  atomic_int users_decoded;
+  atomic_bool failed;
+} Decoder;
+
+bool is_snapshot_filename(const char *filename) {
+  size_t length = strlen(filename);
+  size_t suffix = strlen(SNAPSHOT_EXTENSION);
+  return length >= suffix &&
+         strcmp(filename + length - suffix, SNAPSHOT_EXTENSION) == 0;
+}
+
+/* Encoding */
+
+static int dictionary_index(Dictionary *dict, const char *str) {
+  unsigned hash = 2166136261u;
+  for (const char *p = str; *p; p++) {
+    hash = (hash ^ (unsigned char)*p) * 16777619u;
+  }
+
+  for (unsigned slot = hash;; slot++) {
+    int *entry = &dict->slots[slot & (DICTIONARY_SLOTS - 1)];
+    if (*entry == 0) {
+      dict->strings[dict->count] = str;
+      *entry = ++dict->count;
+      return *entry - 1;
+    }
+    if (strcmp(dict->strings[*entry - 1], str) == 0) {
+      return *entry - 1;
+    }
+  }
+}
+
+static void encode_books(ByteBuffer *raw, const Library *lib, int first,
+                         int end, Dictionary *authors, Dictionary *genres) {
+  int previous_id = 0;
+  buffer_put_varint(raw, (uint64_t)first);
+  buffer_put_varint(raw, (uint64_t)(end - first));
+  for (int i = first; i < end; i++) {
+    const Book *book = &lib->books[i];
+    buffer_put_svarint(raw, book->id - previous_id);
+    buffer_put_string(raw, book->title);
+    buffer_put_varint(raw, (uint64_t)dictionary_index(authors, book->author));
+    buffer_put_varint(raw, (uint64_t)dictionary_index(genres, book->genre));
+    buffer_put_u8(raw, book->status);
+    buffer_put_svarint(raw, book->borrower_id);
+    previous_id = book->id;
+  }
+}
+
+static void encode_users(ByteBuffer *raw, const Library *lib, int first,
+                         int end) {
+  int previous_id = 0;
+  buffer_put_varint(raw, (uint64_t)first);
+  buffer_put_varint(raw, (uint64_t)(end - first));
+  for (int i = first; i < end; i++) {
+    const User *user = &lib->users[i];
+    int64_t previous_date = 0;
+    buffer_put_svarint(raw, user->id - previous_id);
+    buffer_put_string(raw, user->name);
+    buffer_put_varint(raw, (uint64_t)user->borrowed_count);
+    for (int j = 0; j < user->borrowed_count; j++) {
+      buffer_put_svarint(raw, user->borrowed_book_ids[j]);
+      buffer_put_svarint(raw, (int64_t)user->borrow_dates[j] - previous_date);
+      previous_date = (int64_t)user->borrow_dates[j];
+    }
+    previous_id = user->id;
+  }
+}
+
+static void encode_top_entries(ByteBuffer *raw, const TopKEntry *slots,
+                               int count) {
+  buffer_put_varint(raw, (uint64_t)count);
+  for (int i = 0; i < count; i++) {
+    buffer_put_string(raw, slots[i].key);
+    buffer_put_varint(raw, slots[i].count);
+    buffer_put_varint(raw, slots[i].error);
+  }
+}
+
+static void encode_circulation(ByteBuffer *raw, const CirculationStats *stats) {
+  buffer_put_varint(raw, stats->total_checkouts);
+  encode_top_entries(raw, stats->titles, stats->title_count);
+  encode_top_entries(raw, stats->authors, stats->author_count);
+  for (int i = 0; i < HISTORY_DAYS; i++) {
+    buffer_put_svarint(raw, stats->days[i]);
+    buffer_put_varint(raw, stats->checkouts[i]);
+    buffer_put_varint(raw, stats->returns[i]);
+  }
+}
+
+static void encode_meta(ByteBuffer *raw, const Library *lib,
+                        const Dictionary *authors, const Dictionary *genres) {
+  buffer_put_varint(raw, (uint64_t)lib->book_count);
+  buffer_put_varint(raw, (uint64_t)lib->next_book_id);
+  buffer_put_varint(raw, (uint64_t)lib->user_count);
+  buffer_put_varint(raw, (uint64_t)lib->next_user_id);
+
+  buffer_put_varint(raw, (uint64_t)authors->count);
+  for (int i = 0; i < authors->count; i++) {
+    buffer_put_string(raw, authors->strings[i]);
+  }
+  buffer_put_varint(raw, (uint64_t)genres->count);
+  for (int i = 0; i < genres->count; i++) {
+    buffer_put_string(raw, genres->strings[i]);
+  }
+
+  buffer_put_varint(raw, (uint64_t)lib->hold_count);
+  for (int i = 0; i < lib->book_count; i++) {
+    for (int entry = lib->books[i].hold_head; entry != NO_HOLD;
+         entry = lib->holds[entry].next) {
+      const HoldEntry *hold = &lib->holds[entry];
+      buffer_put_svarint(raw, hold->book_id);
+      buffer_put_svarint(raw, hold->user_id);
+      buffer_put_svarint(raw, (int64_t)hold->placed);
+    }
+  }
+
+  encode_circulation(raw, &lib->circulation);
+}
+
+static void append_block(ByteBuffer *table, ByteBuffer *body, char kind,
+                         const ByteBuffer *raw) {
+  unsigned char *compressed = malloc(lz_compress_bound(raw->size));
+  if (compressed == NULL || raw->failed) {
+    free(compressed);
+    table->failed = true;
+    return;
+  }
+
+  size_t size = lz_compress(raw->data, raw->size, compressed);
+  buffer_put_u8(table, (unsigned char)kind);
+  buffer_put_u32(table, (uint32_t)raw->size);
+  buffer_put_u32(table, (uint32_t)size);
+  buffer_put_u32(table, crc32c(0, compressed, size));
+  buffer_put_bytes(body, compressed, size);
+  free(compressed);
+}
+
+/* Builds the whole snapshot in memory, as saved to disk or sent to a replica */
+ErrorCode encode_compressed_library(const Library *lib, ByteBuffer *out) {
+  Dictionary *authors = calloc(1, sizeof(Dictionary));
+  Dictionary *genres = calloc(1, sizeof(Dictionary));
+  ByteBuffer table, body, raw;
+  buffer_init(&table);
+  buffer_init(&body);
+  buffer_init(&raw);
+  int block_count = 0;
+
+  if (authors == NULL || genres == NULL) {
+    table.failed = true;
+  }
+
+  /* Record blocks first: they fill the dictionaries the meta block stores */
+  for (int first = 0; !table.failed && first < lib->book_count;
+       first += SNAPSHOT_BLOCK_RECORDS) {
+    int end = first + SNAPSHOT_BLOCK_RECORDS < lib->book_count
+                  ? first + SNAPSHOT_BLOCK_RECORDS
+                  : lib->book_count;
+    raw.size = 0;
+    encode_books(&raw, lib, first, end, authors, genres);
+    append_block(&table, &body, BLOCK_BOOKS, &raw);
+    block_count++;
+  }
+  for (int first = 0; !table.failed && first < lib->user_count;
+       first += SNAPSHOT_BLOCK_RECORDS) {
+    int end = first + SNAPSHOT_BLOCK_RECORDS < lib->user_count
+                  ? first + SNAPSHOT_BLOCK_RECORDS
+                  : lib->user_count;
+    raw.size = 0;
+    encode_users(&raw, lib, first, end);
+    append_block(&table, &body, BLOCK_USERS, &raw);
+    block_count++;
+  }
+
+  ByteBuffer meta_table;
+  ByteBuffer meta_body;
+  buffer_init(&meta_table);
+  buffer_init(&meta_body);
+  if (!table.failed) {
+    raw.size = 0;
+    encode_meta(&raw, lib, authors, genres);
+    append_block(&meta_table, &meta_body, BLOCK_META, &raw);
+  }
+
+  ByteBuffer header;
+  buffer_init(&header);
+  buffer_put_bytes(&header, SNAPSHOT_MAGIC, 4);
+  buffer_put_u32(&header, (uint32_t)(block_count + 1));
+  buffer_put_bytes(&header, meta_table.data, meta_table.size);
+  buffer_put_bytes(&header, table.data, table.size);
+
+  ErrorCode result = ERROR_FILE_IO;
+  if (!table.failed && !body.failed && !meta_body.failed && !header.failed) {
+    buffer_put_bytes(out, header.data, header.size);
+    buffer_put_bytes(out, meta_body.data, meta_body.size);
+    buffer_put_bytes(out, body.data, body.size);
+    result = out->failed ? ERROR_FILE_IO : SUCCESS;
+  }
+
+  buffer_free(&header);
+  buffer_free(&meta_table);
+  buffer_free(&meta_body);
+  buffer_free(&raw);
+  buffer_free(&body);
+  buffer_free(&table);
+  free(authors);
+  free(genres);
+  return result;
+}
+
+ErrorCode save_compressed_library(Library *lib, const char *filename) {
+  ByteBuffer snapshot;
+  buffer_init(&snapshot);
+  ErrorCode result = encode_compressed_library(lib, &snapshot);
+
+  AtomicFile file;
+  FILE *stream;
+  if (result == SUCCESS) {
+    result = ERROR_FILE_IO;
+    if ((stream = atomic_file_begin(&file, filename)) != NULL) {
+      fwrite(snapshot.data, 1, snapshot.size, stream);
+      result = atomic_file_commit(&file, NULL);
+    }
+  }
+  buffer_free(&snapshot);
+
+  if (result == SUCCESS) {
+    clear_dirty(lib);
+  }
+  return result;
+}
+
+/* Decoding */
+
+static unsigned char *inflate_block(const BlockInfo *block) {
+  if (crc32c(0, block->data, block->compressed_size) != block->crc) {
+    return NULL;
+  }
+
+  unsigned char *raw = malloc(block->raw_size + 1);
+  if (raw != NULL && !lz_decompress(block->data, block->compressed_size, raw,
+                                    block->raw_size)) {
+    free(raw);
+    raw = NULL;
+  }
+  return raw;
+}
+
+static bool decode_books(Decoder *decoder, ByteReader *in) {
+  Library *lib = decoder->lib;
+  uint64_t first = reader_varint(in);
+  uint64_t count = reader_varint(in);
+  if (first + count > (uint64_t)lib->book_count) {
+    return false;
+  }
+
+  int previous_id = 0;
+  for (uint64_t i = first; i < first + count && !in->failed; i++) {
+    Book *book = &lib->books[i];
+    book->id = previous_id + (int)reader_svarint(in);
+    reader_string(in, book->title, MAX_TITLE_LENGTH);
+    uint64_t author = reader_varint(in);
+    uint64_t genre = reader_varint(in);
+    book->status = reader_u8(in) == BOOK_BORROWED ? BOOK_BORROWED
+                                                  : BOOK_AVAILABLE;
+    book->borrower_id = (int)reader_svarint(in);
+    book->hold_head = NO_HOLD;
+    book->hold_tail = NO_HOLD;
+    if (author >= (uint64_t)decoder->author_count ||
+        genre >= (uint64_t)decoder->genre_count) {
+      return false;
+    }
+    strcpy(book->author, decoder->authors[author]);
+    strcpy(book->genre, decoder->genres[genre]);
+    previous_id = book->id;
+  }
+  atomic_fetch_add(&decoder->books_decoded, (int)count);
+  return !in->failed;
+}
+
+static bool decode_users(Decoder *decoder, ByteReader *in) {
+  Library *lib = decoder->lib;
+  uint64_t first = reader_varint(in);
+  uint64_t count = reader_varint(in);
+  if (first + count > (uint64_t)lib->user_count) {
+    return false;
+  }
+
+  int previous_id = 0;
+  for (uint64_t i = first; i < first + count && !in->failed; i++) {
+    User *user = &lib->users[i];
+    int64_t previous_date = 0;
+    user->id = previous_id + (int)reader_svarint(in);
+    reader_string(in, user->name, MAX_NAME_LENGTH);
+    uint64_t borrowed = reader_varint(in);
+    if (borrowed > MAX_BORROWED_BOOKS) {
+      return false;
+    }
+    user->borrowed_count = (int)borrowed;
+    for (int j = 0; j < user->borrowed_count; j++) {
+      user->borrowed_book_ids[j] = (int)reader_svarint(in);
+      previous_date += reader_svarint(in);
+      user->borrow_dates[j] = (time_t)previous_date;
+    }
+    previous_id = user->id;
+  }
+  atomic_fetch_add(&decoder->users_decoded, (int)count);
+  return !in->failed;
+}
+
+static bool decode_top_entries(ByteReader *in, TopKEntry *slots, int *count) {
+  uint64_t entries = reader_varint(in);
+  if (entries > TOP_K_SLOTS) {
+    return false;
+  }
+  *count = (int)entries;
+  for (int i = 0; i < *count; i++) {
+    reader_string(in, slots[i].key, MAX_TITLE_LENGTH);
+    slots[i].count = (unsigned long)reader_varint(in);
+    slots[i].error = (unsigned long)reader_varint(in);
+  }
+  return true;
+}
+
+static bool decode_circulation(ByteReader *in, CirculationStats *stats) {
+  stats->total_checkouts = (unsigned long)reader_varint(in);
+  if (!decode_top_entries(in, stats->titles, &stats->title_count) ||
+      !decode_top_entries(in, stats->authors, &stats->author_count)) {
+    return false;
+  }
+  for (int i = 0; i < HISTORY_DAYS; i++) {
+    stats->days[i] = (long)reader_svarint(in);
+    stats->checkouts[i] = (unsigned int)reader_varint(in);
+    stats->returns[i] = (unsigned int)reader_varint(in);
+  }
+  return !in->failed;
+}
+
+static bool decode_meta(Decoder *decoder, ByteReader *in) {
+  Library *lib = decoder->lib;
+  uint64_t book_count = reader_varint(in);
+  lib->next_book_id = (int)reader_varint(in);
+  uint64_t user_count = reader_varint(in);
+  lib->next_user_id = (int)reader_varint(in);
+  if (book_count > MAX_BOOKS || user_count > MAX_USERS) {
+    return false;
+  }
+  lib->book_count = (int)book_count;
+  lib->user_count = (int)user_count;
+
+  uint64_t authors = reader_varint(in);
+  if (authors > MAX_BOOKS) {
+    return false;
+  }
+  decoder->author_count = (int)authors;
+  for (int i = 0; i < decoder->author_count; i++) {
+    reader_string(in, decoder->authors[i], MAX_AUTHOR_LENGTH);
+  }
+
+  uint64_t genres = reader_varint(in);
+  if (genres > MAX_BOOKS) {
+    return false;
+  }
+  decoder->genre_count = (int)genres;
+  for (int i = 0; i < decoder->genre_count; i++) {
+    reader_string(in, decoder->genres[i], MAX_GENRE_LENGTH);
+  }
+
+  /* Snapshots written before hold queues existed end here */
+  clear_circulation(&decoder->circulation);
+  if (in->cursor == in->end) {
+    return !in->failed;
+  }
+  uint64_t holds = reader_varint(in);
+  if (holds > MAX_HOLDS) {
+    return false;
+  }
+  decoder->hold_count = (int)holds;
+  for (int i = 0; i < decoder->hold_count; i++) {
+    decoder->holds[i].book_id = (int)reader_svarint(in);
+    decoder->holds[i].user_id = (int)reader_svarint(in);
+    decoder->holds[i].placed = (time_t)reader_svarint(in);
+  }
+
+  /* ...and those written before circulation statistics were kept here */
+  if (in->cursor == in->end) {
+    return !in->failed;
+  }
+  return decode_circulation(in, &decoder->circulation);
+}
+
+static void *decode_worker(void *arg) {
+  Decoder *decoder = arg;
+  int index;
+  while ((index = atomic_fetch_add(&decoder->next_block, 1)) <
+         decoder->block_count) {
+    const BlockInfo *block = &decoder->blocks[index];
+    unsigned char *raw = inflate_block(block);
+    bool ok = raw != NULL;
+    if (ok) {
+      ByteReader in;
+      reader_init(&in, raw, block->raw_size);
+      ok = block->kind == BLOCK_BOOKS   ? decode_books(decoder, &in)
+           : block->kind == BLOCK_USERS ? decode_users(decoder, &in)
+                                        : false;
+    }
+    free(raw);
+    if (!ok) {
+      atomic_store(&decoder->failed, true);
+    }
+  }
+  return NULL;
+}
+
+static bool read_block_table(Decoder *decoder, const char *data,
+                             size_t size) {
+  ByteReader in;
+  reader_init(&in, data, size);
+  const unsigned char *magic = reader_bytes(&in, 4);
+  uint32_t count = reader_u32(&in);
+  if (magic == NULL || memcmp(magic, SNAPSHOT_MAGIC, 4) != 0 || count == 0 ||
+      count > MAX_BLOCKS) {
+    return false;
+  }
+
+  decoder->block_count = (int)count;
+  for (uint32_t i = 0; i < count; i++) {
+    BlockInfo *block = &decoder->blocks[i];
+    block->kind = (char)reader_u8(&in);
+    block->raw_size = reader_u32(&in);
+    block->compressed_size = reader_u32(&in);
+    block->crc = reader_u32(&in);
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    decoder->blocks[i].data =
+        reader_bytes(&in, decoder->blocks[i].compressed_size);
+  }
+  return !in.failed && decoder->blocks[0].kind == BLOCK_META;
+}
+
+ErrorCode load_compressed_library(Library *lib, const char *data, size_t size) {
+  Decoder *decoder = calloc(1, sizeof(Decoder));
+  char(*authors)[MAX_AUTHOR_LENGTH] = calloc(MAX_BOOKS, MAX_AUTHOR_LENGTH);
+  char(*genres)[MAX_GENRE_LENGTH] = calloc(MAX_BOOKS, MAX_GENRE_LENGTH);
+  bool ok = decoder != NULL && authors != NULL && genres != NULL;
+
+  if (ok) {
+    decoder->lib = lib;
+    decoder->authors = authors;
+    decoder->genres = genres;
+    ok = read_block_table(decoder, data, size);
+  }
+
+  /* The dictionary block is needed by every other block */
+  if (ok) {
+    unsigned char *raw = inflate_block(&decoder->blocks[0]);
+    ByteReader in;
+    reader_init(&in, raw, raw == NULL ? 0 : decoder->blocks[0].raw_size);
+    ok = raw != NULL && decode_meta(decoder, &in);
+    free(raw);
+  }
+
+  if (ok) {
+    atomic_init(&decoder->next_block, 1);
+    atomic_init(&decoder->books_decoded, 0);
+    atomic_init(&decoder->users_decoded, 0);
+    atomic_init(&decoder->failed, false);
+
+    pthread_t threads[SNAPSHOT_DECODE_THREADS];
+    int started = 0;
+    int wanted = decoder->block_count - 1;
+    if (wanted > SNAPSHOT_DECODE_THREADS) {
+      wanted = SNAPSHOT_DECODE_THREADS;
+    }
+    /* The calling thread decodes too, so one block needs no extra thread */
+    while (started < wanted - 1 &&
+           pthread_create(&threads[started], NULL, decode_worker, decoder) ==
+               0) {
+      started++;
+    }
+    decode_worker(decoder);
+    for (int i = 0; i < started; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    ok = !atomic_load(&decoder->failed) &&
+         atomic_load(&decoder->books_decoded) == lib->book_count &&
+         atomic_load(&decoder->users_decoded) == lib->user_count;
+  }
+
+  if (ok) {
+    clear_holds(lib);
+    for (int i = 0; i < decoder->hold_count; i++) {
+      Book *book = find_book_by_id(lib, decoder->holds[i].book_id);
+      if (book != NULL) {
+        append_hold(lib, book, decoder->holds[i].user_id,
+                    decoder->holds[i].placed);
+      }
+    }
+    lib->circulation = decoder->circulation;
+  }
+
+  bool allocated = decoder != NULL && authors != NULL && genres != NULL;
+  free(genres);
+  free(authors);
+  free(decoder);
+  if (!ok) {
+    return allocated ? ERROR_CORRUPT_FILE : ERROR_FILE_IO;
+  }
+
+  lib->format = FORMAT_COMPRESSED;
+  clear_dirty(lib);
+  library_touch(lib);
+  return SUCCESS;
+}
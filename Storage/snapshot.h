@@ -0,0 +1,19 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "../Utils/utils.h"
+#include "codec.h"
+
+/* Compressed Snapshot Constants */
+#define SNAPSHOT_MAGIC "LBZ1"
+#define SNAPSHOT_EXTENSION ".lbz"
+#define SNAPSHOT_BLOCK_RECORDS 32
+#define SNAPSHOT_DECODE_THREADS 4
+
+/* Compressed Snapshot Functions */
+bool is_snapshot_filename(const char *filename);
+ErrorCode encode_compressed_library(const Library *lib, ByteBuffer *out);
+ErrorCode save_compressed_library(Library *lib, const char *filename);
+ErrorCode load_compressed_library(Library *lib, const char *data, size_t size);
+
+#endif /* SNAPSHOT_H */
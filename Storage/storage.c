@@ -0,0 +1,480 @@
+#include "storage.h"
+#include "crc32c.h"
+#include "../Analytics/analytics.h"
+#include "../Book/book.h"
+#include "../Hold/hold.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * Every file is built in memory, followed by a "#CRC32C xxxxxxxx" trailer
+ * over the preceding bytes, written to "<path>.tmp", fsync'ed and renamed
+ * over the target, and the directory is fsync'ed so the rename survives a
+ * crash. A reader therefore sees either the old or the new file, and a torn
+ * or corrupted one fails its checksum instead of loading garbage.
+ */
+
+FILE *atomic_file_begin(AtomicFile *file, const char *path) {
+  strncpy(file->path, path, MAX_PATH_LENGTH - 1);
+  file->path[MAX_PATH_LENGTH - 1] = '\0';
+  file->data = NULL;
+  file->size = 0;
+  file->stream = open_memstream(&file->data, &file->size);
+  return file->stream;
+}
+
+static ErrorCode write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return ERROR_FILE_IO;
+    }
+    data += n;
+    size -= (size_t)n;
+  }
+  return SUCCESS;
+}
+
+static void sync_parent_directory(const char *path) {
+  char dir[MAX_PATH_LENGTH];
+  strncpy(dir, path, sizeof(dir) - 1);
+  dir[sizeof(dir) - 1] = '\0';
+
+  char *slash = strrchr(dir, '/');
+  if (slash == NULL) {
+    strcpy(dir, ".");
+  } else if (slash == dir) {
+    slash[1] = '\0';
+  } else {
+    *slash = '\0';
+  }
+
+  int fd = open(dir, O_RDONLY);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+ErrorCode atomic_file_commit(AtomicFile *file, uint32_t *crc) {
+  bool failed = ferror(file->stream) != 0;
+  if (fclose(file->stream) != 0 || file->data == NULL) {
+    failed = true;
+  }
+  if (failed) {
+    free(file->data);
+    return ERROR_FILE_IO;
+  }
+
+  uint32_t checksum = crc32c(0, file->data, file->size);
+  char trailer[32];
+  int trailer_length =
+      snprintf(trailer, sizeof(trailer), "%s%08x\n", CHECKSUM_TAG, checksum);
+
+  char temp[MAX_PATH_LENGTH + 8];
+  snprintf(temp, sizeof(temp), "%s.tmp", file->path);
+
+  ErrorCode result = ERROR_FILE_IO;
+  int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0) {
+    if (write_all(fd, file->data, file->size) == SUCCESS &&
+        write_all(fd, trailer, (size_t)trailer_length) == SUCCESS &&
+        fsync(fd) == 0) {
+      result = SUCCESS;
+    }
+    if (close(fd) != 0) {
+      result = ERROR_FILE_IO;
+    }
+  }
+  free(file->data);
+
+  if (result == SUCCESS && rename(temp, file->path) != 0) {
+    result = ERROR_FILE_IO;
+  }
+  if (result != SUCCESS) {
+    remove(temp);
+    return result;
+  }
+
+  sync_parent_directory(file->path);
+  if (crc != NULL) {
+    *crc = checksum;
+  }
+  return SUCCESS;
+}
+
+ErrorCode read_checked_file(const char *path, bool require_checksum,
+                            char **data, size_t *size, uint32_t *crc) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return ERROR_FILE_IO;
+  }
+
+  char *buffer = NULL;
+  size_t length = 0;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    long end = ftell(file);
+    if (end >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+      buffer = malloc((size_t)end + 1);
+      if (buffer != NULL) {
+        length = fread(buffer, 1, (size_t)end, file);
+      }
+      if (buffer != NULL && length != (size_t)end) {
+        free(buffer);
+        buffer = NULL;
+      }
+    }
+  }
+  fclose(file);
+  if (buffer == NULL) {
+    return ERROR_FILE_IO;
+  }
+  buffer[length] = '\0';
+
+  /* The trailer has a fixed size, so binary bodies are handled too */
+  size_t trailer_length = strlen(CHECKSUM_TAG) + 9;
+  bool has_trailer =
+      length >= trailer_length &&
+      strncmp(buffer + length - trailer_length, CHECKSUM_TAG,
+              strlen(CHECKSUM_TAG)) == 0;
+  uint32_t checksum = 0;
+  if (has_trailer) {
+    size_t body = length - trailer_length;
+    unsigned long stored = strtoul(buffer + body + strlen(CHECKSUM_TAG), NULL,
+                                   16);
+    checksum = crc32c(0, buffer, body);
+    if (checksum != (uint32_t)stored) {
+      free(buffer);
+      return ERROR_CORRUPT_FILE;
+    }
+    buffer[body] = '\0';
+    length = body;
+  } else if (require_checksum) {
+    free(buffer); /* torn: the trailer is written last */
+    return ERROR_CORRUPT_FILE;
+  }
+
+  *data = buffer;
+  if (size != NULL) {
+    *size = length;
+  }
+  if (crc != NULL) {
+    *crc = checksum;
+  }
+  return SUCCESS;
+}
+
+char *next_line(char **cursor) {
+  char *line = *cursor;
+  if (line == NULL || *line == '\0') {
+    return NULL;
+  }
+
+  char *end = strchr(line, '\n');
+  if (end != NULL) {
+    *end = '\0';
+    *cursor = end + 1;
+  } else {
+    *cursor = line + strlen(line);
+  }
+  return line;
+}
+
+/*
+ * Segmented layout: the data file is a manifest holding the library
+ * metadata and one "SEG|kind|index|seq|crc" line per segment; the records
+ * live in "<file>.<kind><index>.<seq>" files of SEGMENT_RECORDS slots each.
+ * A checkpoint writes fresh files only for segments with a dirty slot,
+ * reuses every other segment as listed in the current manifest, and then
+ * replaces the manifest, so a crash at any point leaves the previous
+ * manifest pointing at intact files. Superseded files are removed last.
+ * Hold queues and circulation statistics are small and change without
+ * touching any record, so they are kept as lines in the manifest itself.
+ */
+
+typedef struct {
+  bool present;
+  unsigned long seq;
+  uint32_t crc;
+} SegmentEntry;
+
+typedef struct {
+  unsigned long checkpoint;
+  int book_count;
+  int next_book_id;
+  int user_count;
+  int next_user_id;
+  SegmentEntry books[BOOK_SEGMENTS];
+  SegmentEntry users[USER_SEGMENTS];
+  HoldEntry holds[MAX_HOLDS]; /* in queue order */
+  int hold_count;
+  CirculationStats circulation;
+} Manifest;
+
+static void segment_path(char *buffer, size_t size, const char *filename,
+                         char kind, int segment, unsigned long seq) {
+  snprintf(buffer, size, "%s.%c%d.%lu", filename, kind, segment, seq);
+}
+
+static int segment_count(int records) {
+  return (records + SEGMENT_RECORDS - 1) / SEGMENT_RECORDS;
+}
+
+static ErrorCode read_manifest(const char *filename, Manifest *manifest) {
+  char *data;
+  ErrorCode result = read_checked_file(filename, true, &data, NULL, NULL);
+  if (result != SUCCESS) {
+    return result;
+  }
+
+  memset(manifest, 0, sizeof(*manifest));
+  clear_circulation(&manifest->circulation);
+  char *cursor = data;
+  char *line = next_line(&cursor);
+  bool valid =
+      line != NULL &&
+      sscanf(line, SEGMENT_MAGIC " %lu", &manifest->checkpoint) == 1 &&
+      (line = next_line(&cursor)) != NULL &&
+      sscanf(line, "%d %d %d %d", &manifest->book_count,
+             &manifest->next_book_id, &manifest->user_count,
+             &manifest->next_user_id) == 4 &&
+      manifest->book_count >= 0 && manifest->book_count <= MAX_BOOKS &&
+      manifest->user_count >= 0 && manifest->user_count <= MAX_USERS;
+
+  while (valid && (line = next_line(&cursor)) != NULL) {
+    char kind;
+    int index;
+    unsigned long seq, crc;
+    long placed;
+    HoldEntry *hold = &manifest->holds[manifest->hold_count];
+    if (manifest->hold_count < MAX_HOLDS &&
+        sscanf(line, "HOLD|%d|%d|%ld", &hold->book_id, &hold->user_id,
+               &placed) == 3) {
+      hold->placed = (time_t)placed;
+      manifest->hold_count++;
+      continue;
+    }
+    if (parse_circulation_record(&manifest->circulation, line)) {
+      continue;
+    }
+    if (sscanf(line, "SEG|%c|%d|%lu|%lx", &kind, &index, &seq, &crc) != 4) {
+      continue;
+    }
+
+    SegmentEntry *entry = NULL;
+    if (kind == 'b' && index >= 0 && index < BOOK_SEGMENTS) {
+      entry = &manifest->books[index];
+    } else if (kind == 'u' && index >= 0 && index < USER_SEGMENTS) {
+      entry = &manifest->users[index];
+    }
+    if (entry != NULL) {
+      entry->present = true;
+      entry->seq = seq;
+      entry->crc = (uint32_t)crc;
+    }
+  }
+
+  free(data);
+  return valid ? SUCCESS : ERROR_CORRUPT_FILE;
+}
+
+static ErrorCode write_segment(const Library *lib, const char *filename,
+                               char kind, int segment, SegmentEntry *entry) {
+  char path[MAX_PATH_LENGTH];
+  segment_path(path, sizeof(path), filename, kind, segment, entry->seq);
+
+  AtomicFile file;
+  FILE *stream = atomic_file_begin(&file, path);
+  if (stream == NULL) {
+    return ERROR_FILE_IO;
+  }
+
+  int records = kind == 'b' ? lib->book_count : lib->user_count;
+  int end = (segment + 1) * SEGMENT_RECORDS;
+  if (end > records) {
+    end = records;
+  }
+  for (int i = segment * SEGMENT_RECORDS; i < end; i++) {
+    if (kind == 'b') {
+      write_book_record(stream, &lib->books[i]);
+    } else {
+      write_user_record(stream, &lib->users[i]);
+    }
+  }
+
+  return atomic_file_commit(&file, &entry->crc);
+}
+
+static ErrorCode write_segments(const Library *lib, const char *filename,
+                                char kind, const unsigned int *dirty,
+                                int count, const SegmentEntry *old,
+                                SegmentEntry *next, unsigned long seq) {
+  for (int segment = 0; segment < count; segment++) {
+    bool changed = any_dirty(dirty, segment * SEGMENT_RECORDS,
+                             (segment + 1) * SEGMENT_RECORDS);
+    if (old[segment].present && !changed) {
+      next[segment] = old[segment];
+      continue;
+    }
+
+    next[segment].present = true;
+    next[segment].seq = seq;
+    if (write_segment(lib, filename, kind, segment, &next[segment]) !=
+        SUCCESS) {
+      return ERROR_FILE_IO;
+    }
+  }
+  return SUCCESS;
+}
+
+static void remove_superseded(const char *filename, char kind,
+                              const SegmentEntry *old, const SegmentEntry *next,
+                              int capacity) {
+  for (int segment = 0; segment < capacity; segment++) {
+    if (old[segment].present &&
+        (!next[segment].present || next[segment].seq != old[segment].seq)) {
+      char path[MAX_PATH_LENGTH];
+      segment_path(path, sizeof(path), filename, kind, segment,
+                   old[segment].seq);
+      remove(path);
+    }
+  }
+}
+
+ErrorCode checkpoint_library(Library *lib, const char *filename) {
+  Manifest old;
+  if (read_manifest(filename, &old) != SUCCESS) {
+    memset(&old, 0, sizeof(old));
+  }
+
+  Manifest next;
+  memset(&next, 0, sizeof(next));
+  next.checkpoint = old.checkpoint + 1;
+
+  if (write_segments(lib, filename, 'b', lib->book_dirty,
+                     segment_count(lib->book_count), old.books, next.books,
+                     next.checkpoint) != SUCCESS ||
+      write_segments(lib, filename, 'u', lib->user_dirty,
+                     segment_count(lib->user_count), old.users, next.users,
+                     next.checkpoint) != SUCCESS) {
+    return ERROR_FILE_IO;
+  }
+
+  AtomicFile file;
+  FILE *stream = atomic_file_begin(&file, filename);
+  if (stream == NULL) {
+    return ERROR_FILE_IO;
+  }
+  fprintf(stream, "%s %lu\n", SEGMENT_MAGIC, next.checkpoint);
+  fprintf(stream, "%d %d %d %d\n", lib->book_count, lib->next_book_id,
+          lib->user_count, lib->next_user_id);
+  for (int segment = 0; segment < BOOK_SEGMENTS; segment++) {
+    if (next.books[segment].present) {
+      fprintf(stream, "SEG|b|%d|%lu|%08x\n", segment, next.books[segment].seq,
+              (unsigned)next.books[segment].crc);
+    }
+  }
+  for (int segment = 0; segment < USER_SEGMENTS; segment++) {
+    if (next.users[segment].present) {
+      fprintf(stream, "SEG|u|%d|%lu|%08x\n", segment, next.users[segment].seq,
+              (unsigned)next.users[segment].crc);
+    }
+  }
+  write_hold_records(stream, lib);
+  write_circulation_records(stream, &lib->circulation);
+  if (atomic_file_commit(&file, NULL) != SUCCESS) {
+    return ERROR_FILE_IO;
+  }
+
+  remove_superseded(filename, 'b', old.books, next.books, BOOK_SEGMENTS);
+  remove_superseded(filename, 'u', old.users, next.users, USER_SEGMENTS);
+  clear_dirty(lib);
+  return SUCCESS;
+}
+
+static ErrorCode load_segment(Library *lib, const char *filename, char kind,
+                              int segment, const SegmentEntry *entry,
+                              int records) {
+  if (!entry->present) {
+    return ERROR_CORRUPT_FILE;
+  }
+
+  char path[MAX_PATH_LENGTH];
+  segment_path(path, sizeof(path), filename, kind, segment, entry->seq);
+
+  /* The manifest names this segment, so a missing file is damage too */
+  char *data;
+  uint32_t crc;
+  ErrorCode result = read_checked_file(path, true, &data, NULL, &crc);
+  if (result != SUCCESS) {
+    return access(path, F_OK) == 0 ? result : ERROR_CORRUPT_FILE;
+  }
+  if (crc != entry->crc) {
+    free(data);
+    return ERROR_CORRUPT_FILE;
+  }
+
+  int index = segment * SEGMENT_RECORDS;
+  int end = index + SEGMENT_RECORDS < records ? index + SEGMENT_RECORDS
+                                              : records;
+  char *cursor = data;
+  char *line;
+  while (index < end && (line = next_line(&cursor)) != NULL) {
+    if (kind == 'b' && strncmp(line, "BOOK|", 5) == 0) {
+      parse_book_record(line, &lib->books[index++]);
+    } else if (kind == 'u' && strncmp(line, "USER|", 5) == 0) {
+      parse_user_record(line, &lib->users[index++]);
+    }
+  }
+
+  free(data);
+  return index == end ? SUCCESS : ERROR_CORRUPT_FILE;
+}
+
+ErrorCode load_segmented_library(Library *lib, const char *filename) {
+  Manifest manifest;
+  ErrorCode result = read_manifest(filename, &manifest);
+  if (result != SUCCESS) {
+    return result;
+  }
+
+  lib->book_count = manifest.book_count;
+  lib->next_book_id = manifest.next_book_id;
+  lib->user_count = manifest.user_count;
+  lib->next_user_id = manifest.next_user_id;
+
+  for (int segment = 0; segment < segment_count(lib->book_count); segment++) {
+    result = load_segment(lib, filename, 'b', segment,
+                          &manifest.books[segment], lib->book_count);
+    if (result != SUCCESS) {
+      return result;
+    }
+  }
+  for (int segment = 0; segment < segment_count(lib->user_count); segment++) {
+    result = load_segment(lib, filename, 'u', segment,
+                          &manifest.users[segment], lib->user_count);
+    if (result != SUCCESS) {
+      return result;
+    }
+  }
+
+  clear_holds(lib);
+  for (int i = 0; i < manifest.hold_count; i++) {
+    Book *book = find_book_by_id(lib, manifest.holds[i].book_id);
+    if (book != NULL) {
+      append_hold(lib, book, manifest.holds[i].user_id,
+                  manifest.holds[i].placed);
+    }
+  }
+  lib->circulation = manifest.circulation;
+
+  lib->format = FORMAT_SEGMENTED;
+  clear_dirty(lib);
+  library_touch(lib);
+  return SUCCESS;
+}
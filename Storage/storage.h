@@ -0,0 +1,35 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include "../Utils/utils.h"
+
+#include <stdint.h>
+
+/* Segmented Storage Constants */
+#define SEGMENT_MAGIC "SEGMENTED 2"
+#define SEGMENT_RECORDS 16
+#define BOOK_SEGMENTS ((MAX_BOOKS + SEGMENT_RECORDS - 1) / SEGMENT_RECORDS)
+#define USER_SEGMENTS ((MAX_USERS + SEGMENT_RECORDS - 1) / SEGMENT_RECORDS)
+#define MAX_PATH_LENGTH 256
+#define CHECKSUM_TAG "#CRC32C "
+
+/* Type Definitions */
+typedef struct {
+  char path[MAX_PATH_LENGTH];
+  FILE *stream;
+  char *data;
+  size_t size;
+} AtomicFile;
+
+/* Crash-safe File Functions */
+FILE *atomic_file_begin(AtomicFile *file, const char *path);
+ErrorCode atomic_file_commit(AtomicFile *file, uint32_t *crc);
+ErrorCode read_checked_file(const char *path, bool require_checksum,
+                            char **data, size_t *size, uint32_t *crc);
+char *next_line(char **cursor);
+
+/* Segmented Storage Functions */
+ErrorCode checkpoint_library(Library *lib, const char *filename);
+ErrorCode load_segmented_library(Library *lib, const char *filename);
+
+#endif /* STORAGE_H */
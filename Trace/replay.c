@@ -0,0 +1,266 @@
+#include "trace.h"
+#include "../Version/version.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * The replayer loads a whole trace and lets N threads claim records in
+ * order from a shared cursor. Searches run on a read snapshot of a
+ * VersionedLibrary and every other call as a write on a private copy, so
+ * readers proceed while a writer works; concurrent threads may reorder
+ * neighbouring calls, which shows up as a different failure count. Paced
+ * replays wait for each record's recorded offset. Latencies go into a
+ * log-linear histogram: 8 buckets per power of two, about 12% wide.
+ */
+
+ErrorCode load_trace(const char *path, TraceRecord **records, int *count) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return ERROR_FILE_IO;
+  }
+
+  ByteBuffer data;
+  buffer_init(&data);
+  unsigned char chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    buffer_put_bytes(&data, chunk, n);
+  }
+  bool read_failed = ferror(file) != 0;
+  fclose(file);
+  if (read_failed || data.failed || data.size < 4 ||
+      memcmp(data.data, TRACE_MAGIC, 4) != 0) {
+    buffer_free(&data);
+    return ERROR_FILE_IO;
+  }
+
+  ByteReader in;
+  reader_init(&in, data.data + 4, data.size - 4);
+  int capacity = 0;
+  int used = 0;
+  TraceRecord *list = NULL;
+  uint64_t previous_us = 0;
+  while (in.cursor < in.end) {
+    if (used == capacity) {
+      capacity = capacity == 0 ? 256 : capacity * 2;
+      TraceRecord *grown = realloc(list, sizeof(TraceRecord) * (size_t)capacity);
+      if (grown == NULL) {
+        free(list);
+        buffer_free(&data);
+        return ERROR_FILE_IO;
+      }
+      list = grown;
+    }
+    /* A trace cut short by a crash ends at its last whole record */
+    if (!decode_trace_record(&in, &list[used], previous_us)) {
+      break;
+    }
+    previous_us = list[used].offset_us;
+    used++;
+  }
+
+  buffer_free(&data);
+  *records = list;
+  *count = used;
+  return SUCCESS;
+}
+
+static int latency_bucket(uint64_t ns) {
+  if (ns < 8) {
+    return (int)ns;
+  }
+  int exponent = 63 - __builtin_clzll(ns);
+  int bucket = (exponent - 2) * 8 + (int)((ns >> (exponent - 3)) & 7);
+  return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/* Upper bound of a bucket */
+static uint64_t bucket_limit(int bucket) {
+  if (bucket < 8) {
+    return (uint64_t)bucket;
+  }
+  int exponent = bucket / 8 + 2;
+  uint64_t mantissa = 8 + (uint64_t)(bucket % 8) + 1;
+  return (mantissa << (exponent - 3)) - 1;
+}
+
+typedef struct {
+  VersionedLibrary *versions;
+  const TraceRecord *records;
+  int count;
+  bool paced;
+  atomic_int *cursor;
+  struct timespec start;
+  ReplayReport report;
+} ReplayWorker;
+
+static uint64_t nanoseconds_since(const struct timespec *since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)(now.tv_sec - since->tv_sec) * 1000000000u +
+         (uint64_t)(now.tv_nsec - since->tv_nsec);
+}
+
+static void wait_until(const struct timespec *start, uint64_t offset_us) {
+  uint64_t elapsed = nanoseconds_since(start);
+  uint64_t target = offset_us * 1000u;
+  if (target > elapsed) {
+    uint64_t delay = target - elapsed;
+    struct timespec pause = {(time_t)(delay / 1000000000u),
+                             (long)(delay % 1000000000u)};
+    nanosleep(&pause, NULL);
+  }
+}
+
+static ErrorCode replay_one(VersionedLibrary *versions,
+                            const TraceRecord *record) {
+  if (record->op == TRACE_SEARCH) {
+    ReadSnapshot snapshot;
+    if (read_begin(versions, &snapshot) != SUCCESS) {
+      return ERROR_INVALID_INPUT;
+    }
+    /* Searches only read the library and the thread-safe cache */
+    ErrorCode result =
+        apply_trace_record((Library *)snapshot.lib, record);
+    read_end(versions, &snapshot);
+    return result;
+  }
+
+  Library *next = write_begin(versions);
+  if (next == NULL) {
+    return ERROR_FILE_IO;
+  }
+  ErrorCode result = apply_trace_record(next, record);
+  if (result == SUCCESS) {
+    write_commit(versions, next);
+  } else {
+    write_abort(versions, next);
+  }
+  return result;
+}
+
+static void *replay_worker(void *arg) {
+  ReplayWorker *worker = arg;
+  int index;
+  while ((index = atomic_fetch_add(worker->cursor, 1)) < worker->count) {
+    const TraceRecord *record = &worker->records[index];
+    if (worker->paced) {
+      wait_until(&worker->start, record->offset_us);
+    }
+
+    struct timespec began;
+    clock_gettime(CLOCK_MONOTONIC, &began);
+    ErrorCode result = replay_one(worker->versions, record);
+    uint64_t latency = nanoseconds_since(&began);
+
+    ReplayReport *report = &worker->report;
+    report->count++;
+    report->per_op[record->op]++;
+    if (result != SUCCESS) {
+      report->failed[record->op]++;
+    }
+    report->buckets[latency_bucket(latency)]++;
+    if (latency > report->max_ns) {
+      report->max_ns = latency;
+    }
+  }
+  return NULL;
+}
+
+ErrorCode replay_trace(const Library *initial, const TraceRecord *records,
+                       int count, int threads, bool paced,
+                       ReplayReport *report) {
+  if (threads < 1 || threads > TRACE_MAX_THREADS) {
+    return ERROR_INVALID_INPUT;
+  }
+
+  VersionedLibrary versions;
+  ReplayWorker *workers = calloc((size_t)threads, sizeof(ReplayWorker));
+  if (workers == NULL) {
+    return ERROR_FILE_IO;
+  }
+  if (init_versioned_library(&versions, initial) != SUCCESS) {
+    free(workers);
+    return ERROR_FILE_IO;
+  }
+
+  atomic_int cursor;
+  atomic_init(&cursor, 0);
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  pthread_t ids[TRACE_MAX_THREADS];
+  int started = 0;
+  for (int i = 0; i < threads; i++) {
+    workers[i].versions = &versions;
+    workers[i].records = records;
+    workers[i].count = count;
+    workers[i].paced = paced;
+    workers[i].cursor = &cursor;
+    workers[i].start = start;
+    if (i > 0 && pthread_create(&ids[started], NULL, replay_worker,
+                                &workers[i]) == 0) {
+      started++;
+    }
+  }
+  /* The calling thread is worker 0 */
+  replay_worker(&workers[0]);
+  for (int i = 0; i < started; i++) {
+    pthread_join(ids[i], NULL);
+  }
+
+  memset(report, 0, sizeof(*report));
+  report->elapsed_seconds = (double)nanoseconds_since(&start) / 1e9;
+  for (int i = 0; i < threads; i++) {
+    const ReplayReport *part = &workers[i].report;
+    report->count += part->count;
+    for (int op = 0; op < TRACE_OP_COUNT; op++) {
+      report->per_op[op] += part->per_op[op];
+      report->failed[op] += part->failed[op];
+    }
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+      report->buckets[b] += part->buckets[b];
+    }
+    if (part->max_ns > report->max_ns) {
+      report->max_ns = part->max_ns;
+    }
+  }
+
+  free_versioned_library(&versions);
+  free(workers);
+  return SUCCESS;
+}
+
+uint64_t replay_percentile(const ReplayReport *report, double fraction) {
+  unsigned long rank = (unsigned long)(fraction * (double)report->count);
+  unsigned long seen = 0;
+  for (int b = 0; b < LATENCY_BUCKETS; b++) {
+    seen += report->buckets[b];
+    if (seen > rank) {
+      uint64_t limit = bucket_limit(b);
+      return limit < report->max_ns ? limit : report->max_ns;
+    }
+  }
+  return report->max_ns;
+}
+
+void display_replay_report(const ReplayReport *report, int threads) {
+  printf("\n=== Replay Report ===\n");
+  printf("Calls: %lu on %d thread(s) in %.3f s (%.0f calls/s)\n",
+         report->count, threads, report->elapsed_seconds,
+         report->elapsed_seconds > 0
+             ? (double)report->count / report->elapsed_seconds
+             : 0.0);
+  printf("Latency: p50 %.1f us | p90 %.1f us | p99 %.1f us | max %.1f us\n",
+         replay_percentile(report, 0.50) / 1000.0,
+         replay_percentile(report, 0.90) / 1000.0,
+         replay_percentile(report, 0.99) / 1000.0, report->max_ns / 1000.0);
+  for (int op = 0; op < TRACE_OP_COUNT; op++) {
+    if (report->per_op[op] > 0) {
+      printf("  - %-12s %8lu calls, %lu failed\n",
+             get_trace_op_name((TraceOp)op), report->per_op[op],
+             report->failed[op]);
+    }
+  }
+}
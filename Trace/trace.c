@@ -0,0 +1,346 @@
+#include "trace.h"
+#include "../Book/book.h"
+#include "../Hold/hold.h"
+#include "../Management/management.h"
+#include "../User/user.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Trace file: "LTR1" followed by one record per public API call, each a
+ * u8 operation, the microseconds since the previous record as a varint
+ * and the call's arguments (IDs and times as zig-zag varints, strings
+ * length-prefixed). Calls are logged on entry, whether or not they
+ * succeed, so a replay makes the same calls; calls made from inside
+ * another call (a hold promoted by a return, the steps of a batch) are
+ * suppressed, since replaying the outer call repeats them. A sink, if
+ * set, sees every record in the same order, whether or not a file is
+ * being written; replication ships the log this way.
+ */
+
+static FILE *trace_file = NULL;
+static atomic_bool recording = false;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic(TraceSink) trace_sink = NULL;
+static struct timespec trace_epoch;
+static uint64_t last_us = 0;
+static _Thread_local int suppressed = 0;
+
+static const char *trace_op_names[TRACE_OP_COUNT] = {
+    "add_book",   "update_book", "delete_book", "add_user",
+    "update_user", "delete_user", "borrow",      "return",
+    "place_hold", "cancel_hold", "search"};
+
+const char *get_trace_op_name(TraceOp op) {
+  return op >= 0 && op < TRACE_OP_COUNT ? trace_op_names[op] : "unknown";
+}
+
+/* Recording */
+
+static uint64_t elapsed_us(const struct timespec *since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)(now.tv_sec - since->tv_sec) * 1000000u +
+         (uint64_t)((now.tv_nsec - since->tv_nsec) / 1000);
+}
+
+ErrorCode trace_start(const char *path) {
+  pthread_mutex_lock(&trace_lock);
+  if (trace_file != NULL) {
+    pthread_mutex_unlock(&trace_lock);
+    return ERROR_INVALID_INPUT;
+  }
+
+  trace_file = fopen(path, "wb");
+  if (trace_file == NULL ||
+      fwrite(TRACE_MAGIC, 1, 4, trace_file) != 4) {
+    if (trace_file != NULL) {
+      fclose(trace_file);
+      trace_file = NULL;
+    }
+    pthread_mutex_unlock(&trace_lock);
+    return ERROR_FILE_IO;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &trace_epoch);
+  last_us = 0;
+  atomic_store(&recording, true);
+  pthread_mutex_unlock(&trace_lock);
+  return SUCCESS;
+}
+
+void trace_stop(void) {
+  pthread_mutex_lock(&trace_lock);
+  atomic_store(&recording, false);
+  if (trace_file != NULL) {
+    fclose(trace_file);
+    trace_file = NULL;
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_set_sink(TraceSink sink) {
+  pthread_mutex_lock(&trace_lock);
+  if (trace_file == NULL) {
+    clock_gettime(CLOCK_MONOTONIC, &trace_epoch);
+    last_us = 0;
+  }
+  atomic_store(&trace_sink, sink);
+  pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_suppress(void) { suppressed++; }
+
+void trace_resume(void) { suppressed--; }
+
+static bool trace_wanted(void) {
+  return suppressed == 0 &&
+         (atomic_load(&recording) || atomic_load(&trace_sink) != NULL);
+}
+
+void trace_record(const TraceRecord *record) {
+  if (!trace_wanted()) {
+    return;
+  }
+
+  pthread_mutex_lock(&trace_lock);
+  TraceRecord stamped = *record;
+  stamped.offset_us = elapsed_us(&trace_epoch);
+
+  TraceSink sink = atomic_load(&trace_sink);
+  if (sink != NULL) {
+    sink(&stamped);
+  }
+
+  if (trace_file != NULL) {
+    ByteBuffer out;
+    buffer_init(&out);
+    encode_trace_record(&out, &stamped, last_us);
+    if (!out.failed) {
+      fwrite(out.data, 1, out.size, trace_file);
+      last_us = stamped.offset_us;
+    }
+    buffer_free(&out);
+  }
+  pthread_mutex_unlock(&trace_lock);
+}
+
+static void copy_text(char *dst, const char *src, size_t size) {
+  strncpy(dst, src != NULL ? src : "", size - 1);
+  dst[size - 1] = '\0';
+}
+
+static void trace_book_change(TraceOp op, int book_id, const char *title,
+                              const char *author, const char *genre) {
+  if (!trace_wanted()) {
+    return;
+  }
+  TraceRecord record = {0};
+  record.op = op;
+  record.book_id = book_id;
+  copy_text(record.text, title, sizeof(record.text));
+  copy_text(record.author, author, sizeof(record.author));
+  copy_text(record.genre, genre, sizeof(record.genre));
+  trace_record(&record);
+}
+
+void trace_add_book(const char *title, const char *author, const char *genre) {
+  trace_book_change(TRACE_ADD_BOOK, 0, title, author, genre);
+}
+
+void trace_update_book(int book_id, const char *title, const char *author,
+                       const char *genre) {
+  trace_book_change(TRACE_UPDATE_BOOK, book_id, title, author, genre);
+}
+
+void trace_delete_book(int book_id) {
+  if (!trace_wanted()) {
+    return;
+  }
+  TraceRecord record = {0};
+  record.op = TRACE_DELETE_BOOK;
+  record.book_id = book_id;
+  trace_record(&record);
+}
+
+static void trace_user_change(TraceOp op, int user_id, const char *name) {
+  if (!trace_wanted()) {
+    return;
+  }
+  TraceRecord record = {0};
+  record.op = op;
+  record.user_id = user_id;
+  copy_text(record.text, name, sizeof(record.text));
+  trace_record(&record);
+}
+
+void trace_add_user(const char *name) {
+  trace_user_change(TRACE_ADD_USER, 0, name);
+}
+
+void trace_update_user(int user_id, const char *name) {
+  trace_user_change(TRACE_UPDATE_USER, user_id, name);
+}
+
+void trace_delete_user(int user_id) {
+  if (!trace_wanted()) {
+    return;
+  }
+  TraceRecord record = {0};
+  record.op = TRACE_DELETE_USER;
+  record.user_id = user_id;
+  trace_record(&record);
+}
+
+void trace_loan(TraceOp op, int user_id, int book_id, time_t when) {
+  if (!trace_wanted()) {
+    return;
+  }
+  TraceRecord record = {0};
+  record.op = op;
+  record.user_id = user_id;
+  record.book_id = book_id;
+  record.when = when;
+  trace_record(&record);
+}
+
+void trace_search(SearchField field, const char *term) {
+  if (!trace_wanted()) {
+    return;
+  }
+  TraceRecord record = {0};
+  record.op = TRACE_SEARCH;
+  record.field = field;
+  copy_text(record.text, term, sizeof(record.text));
+  trace_record(&record);
+}
+
+/* Encoding */
+
+void encode_trace_record(ByteBuffer *out, const TraceRecord *record,
+                         uint64_t previous_us) {
+  buffer_put_u8(out, (unsigned)record->op);
+  buffer_put_varint(out, record->offset_us - previous_us);
+
+  switch (record->op) {
+  case TRACE_UPDATE_BOOK:
+    buffer_put_svarint(out, record->book_id);
+    /* fall through */
+  case TRACE_ADD_BOOK:
+    buffer_put_string(out, record->text);
+    buffer_put_string(out, record->author);
+    buffer_put_string(out, record->genre);
+    break;
+  case TRACE_DELETE_BOOK:
+    buffer_put_svarint(out, record->book_id);
+    break;
+  case TRACE_UPDATE_USER:
+    buffer_put_svarint(out, record->user_id);
+    /* fall through */
+  case TRACE_ADD_USER:
+    buffer_put_string(out, record->text);
+    break;
+  case TRACE_DELETE_USER:
+    buffer_put_svarint(out, record->user_id);
+    break;
+  case TRACE_BORROW:
+  case TRACE_RETURN:
+  case TRACE_PLACE_HOLD:
+  case TRACE_CANCEL_HOLD:
+    buffer_put_svarint(out, record->user_id);
+    buffer_put_svarint(out, record->book_id);
+    buffer_put_svarint(out, (int64_t)record->when);
+    break;
+  case TRACE_SEARCH:
+    buffer_put_u8(out, (unsigned)record->field);
+    buffer_put_string(out, record->text);
+    break;
+  default:
+    out->failed = true;
+  }
+}
+
+bool decode_trace_record(ByteReader *in, TraceRecord *record,
+                         uint64_t previous_us) {
+  memset(record, 0, sizeof(*record));
+  unsigned op = reader_u8(in);
+  record->op = (TraceOp)op;
+  record->offset_us = previous_us + reader_varint(in);
+
+  switch (record->op) {
+  case TRACE_UPDATE_BOOK:
+    record->book_id = (int)reader_svarint(in);
+    /* fall through */
+  case TRACE_ADD_BOOK:
+    reader_string(in, record->text, sizeof(record->text));
+    reader_string(in, record->author, sizeof(record->author));
+    reader_string(in, record->genre, sizeof(record->genre));
+    break;
+  case TRACE_DELETE_BOOK:
+    record->book_id = (int)reader_svarint(in);
+    break;
+  case TRACE_UPDATE_USER:
+    record->user_id = (int)reader_svarint(in);
+    /* fall through */
+  case TRACE_ADD_USER:
+    reader_string(in, record->text, sizeof(record->text));
+    break;
+  case TRACE_DELETE_USER:
+    record->user_id = (int)reader_svarint(in);
+    break;
+  case TRACE_BORROW:
+  case TRACE_RETURN:
+  case TRACE_PLACE_HOLD:
+  case TRACE_CANCEL_HOLD:
+    record->user_id = (int)reader_svarint(in);
+    record->book_id = (int)reader_svarint(in);
+    record->when = (time_t)reader_svarint(in);
+    break;
+  case TRACE_SEARCH:
+    record->field = (SearchField)reader_u8(in);
+    reader_string(in, record->text, sizeof(record->text));
+    if (record->field > SEARCH_BY_GENRE) {
+      return false;
+    }
+    break;
+  default:
+    return false;
+  }
+  return !in->failed;
+}
+
+ErrorCode apply_trace_record(Library *lib, const TraceRecord *record) {
+  switch (record->op) {
+  case TRACE_ADD_BOOK:
+    return add_book(lib, record->text, record->author, record->genre);
+  case TRACE_UPDATE_BOOK:
+    return update_book(lib, record->book_id, record->text, record->author,
+                       record->genre);
+  case TRACE_DELETE_BOOK:
+    return delete_book(lib, record->book_id);
+  case TRACE_ADD_USER:
+    return add_user(lib, record->text);
+  case TRACE_UPDATE_USER:
+    return update_user(lib, record->user_id, record->text);
+  case TRACE_DELETE_USER:
+    return delete_user(lib, record->user_id);
+  case TRACE_BORROW:
+    return borrow_book_at(lib, record->user_id, record->book_id, record->when);
+  case TRACE_RETURN:
+    return return_book_at(lib, record->user_id, record->book_id, record->when);
+  case TRACE_PLACE_HOLD:
+    return place_hold_at(lib, record->user_id, record->book_id, record->when);
+  case TRACE_CANCEL_HOLD:
+    return cancel_hold(lib, record->user_id, record->book_id);
+  case TRACE_SEARCH: {
+    RowWriter out;
+    row_writer_init_null(&out, OUTPUT_TABLE);
+    report_book_search(lib, record->field, record->text, &out);
+    row_writer_finish(&out);
+    return SUCCESS;
+  }
+  default:
+    return ERROR_INVALID_INPUT;
+  }
+}
@@ -0,0 +1,87 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "../Cache/cache.h"
+#include "../Storage/codec.h"
+#include "../Utils/utils.h"
+
+#include <stdint.h>
+
+/* Trace Constants */
+#define TRACE_MAGIC "LTR1"
+#define TRACE_MAX_THREADS 64
+#define LATENCY_BUCKETS 320
+
+/* Type Definitions */
+typedef enum {
+  TRACE_ADD_BOOK,
+  TRACE_UPDATE_BOOK,
+  TRACE_DELETE_BOOK,
+  TRACE_ADD_USER,
+  TRACE_UPDATE_USER,
+  TRACE_DELETE_USER,
+  TRACE_BORROW,
+  TRACE_RETURN,
+  TRACE_PLACE_HOLD,
+  TRACE_CANCEL_HOLD,
+  TRACE_SEARCH,
+  TRACE_OP_COUNT
+} TraceOp;
+
+typedef struct {
+  TraceOp op;
+  uint64_t offset_us; /* since the trace started */
+  int user_id;
+  int book_id;
+  time_t when;        /* borrow, return and hold time */
+  SearchField field;
+  char text[MAX_TITLE_LENGTH]; /* title, user name or search term */
+  char author[MAX_AUTHOR_LENGTH];
+  char genre[MAX_GENRE_LENGTH];
+} TraceRecord;
+
+typedef void (*TraceSink)(const TraceRecord *record);
+
+typedef struct {
+  unsigned long count;
+  unsigned long per_op[TRACE_OP_COUNT];
+  unsigned long failed[TRACE_OP_COUNT]; /* returned an error */
+  unsigned long buckets[LATENCY_BUCKETS];
+  uint64_t max_ns;
+  double elapsed_seconds;
+} ReplayReport;
+
+/* Recording */
+ErrorCode trace_start(const char *path);
+void trace_stop(void);
+void trace_set_sink(TraceSink sink);
+void trace_suppress(void);
+void trace_resume(void);
+void trace_record(const TraceRecord *record);
+void trace_add_book(const char *title, const char *author, const char *genre);
+void trace_update_book(int book_id, const char *title, const char *author,
+                       const char *genre);
+void trace_delete_book(int book_id);
+void trace_add_user(const char *name);
+void trace_update_user(int user_id, const char *name);
+void trace_delete_user(int user_id);
+void trace_loan(TraceOp op, int user_id, int book_id, time_t when);
+void trace_search(SearchField field, const char *term);
+
+/* Encoding */
+void encode_trace_record(ByteBuffer *out, const TraceRecord *record,
+                         uint64_t previous_us);
+bool decode_trace_record(ByteReader *in, TraceRecord *record,
+                         uint64_t previous_us);
+ErrorCode apply_trace_record(Library *lib, const TraceRecord *record);
+const char *get_trace_op_name(TraceOp op);
+
+/* Replay */
+ErrorCode load_trace(const char *path, TraceRecord **records, int *count);
+ErrorCode replay_trace(const Library *initial, const TraceRecord *records,
+                       int count, int threads, bool paced,
+                       ReplayReport *report);
+uint64_t replay_percentile(const ReplayReport *report, double fraction);
+void display_replay_report(const ReplayReport *report, int threads);
+
+#endif /* TRACE_H */
@@ -1,8 +1,11 @@
 #include "user.h"
+#include "../Hold/hold.h"
+#include "../Trace/trace.h"
 
 /* User Management Functions */
 
 ErrorCode add_user(Library *lib, const char *name) {
+  trace_add_user(name);
   if (!is_valid_string(name)) {
     return ERROR_INVALID_INPUT;
   }
@@ -17,11 +20,13 @@ ErrorCode add_user(Library *lib, const char *name) {
   new_user->name[MAX_NAME_LENGTH - 1] = '\0';
   new_user->borrowed_count = 0;
 
+  mark_user_dirty(lib, lib->user_count);
   lib->user_count++;
   return SUCCESS;
 }
 
 ErrorCode update_user(Library *lib, int user_id, const char *name) {
+  trace_update_user(user_id, name);
   if (!is_valid_string(name)) {
     return ERROR_INVALID_INPUT;
   }
@@ -34,10 +39,12 @@ ErrorCode update_user(Library *lib, int user_id, const char *name) {
   strncpy(user->name, name, MAX_NAME_LENGTH - 1);
   user->name[MAX_NAME_LENGTH - 1] = '\0';
 
+  mark_user_dirty(lib, (int)(user - lib->users));
   return SUCCESS;
 }
 
 ErrorCode delete_user(Library *lib, int user_id) {
+  trace_delete_user(user_id);
   int index = -1;
   for (int i = 0; i < lib->user_count; i++) {
     if (lib->users[i].id == user_id) {
@@ -55,9 +62,11 @@ ErrorCode delete_user(Library *lib, int user_id) {
     return ERROR_INVALID_INPUT;
   }
 
+  drop_user_holds(lib, user_id);
   for (int i = index; i < lib->user_count - 1; i++) {
     lib->users[i] = lib->users[i + 1];
   }
+  mark_users_dirty(lib, index, lib->user_count);
   lib->user_count--;
 
   return SUCCESS;
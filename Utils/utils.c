@@ -1,12 +1,30 @@
 #include "utils.h"
+#include "../Analytics/analytics.h"
+#include "../Hold/hold.h"
+#include "../Storage/snapshot.h"
+#include "../Storage/storage.h"
+
+#include <stdatomic.h>
 
 /* Utility Functions */
 
+/* Shared across libraries so a generation value is never reused */
+static atomic_ulong generation_source = 0;
+
 void init_library(Library *lib) {
   lib->book_count = 0;
   lib->user_count = 0;
   lib->next_book_id = 1;
   lib->next_user_id = 1;
+  lib->format = FORMAT_SEGMENTED;
+  clear_holds(lib);
+  clear_circulation(&lib->circulation);
+  mark_all_dirty(lib);
+  library_touch(lib);
+}
+
+void library_touch(Library *lib) {
+  lib->generation = atomic_fetch_add(&generation_source, 1) + 1;
 }
 
 int generate_book_id(Library *lib) { return lib->next_book_id++; }
@@ -39,11 +57,30 @@ const char *get_error_message(ErrorCode error) {
     return "File I/O error";
   case ERROR_OVERDUE_BOOK:
     return "Book is overdue";
+  case ERROR_BOOK_AVAILABLE:
+    return "Book is available, borrow it instead";
+  case ERROR_ALREADY_ON_HOLD:
+    return "User already has or is waiting for this book";
+  case ERROR_HOLD_NOT_FOUND:
+    return "Hold not found";
+  case ERROR_MAX_HOLDS_REACHED:
+    return "Maximum number of holds reached";
+  case ERROR_BOOK_HAS_HOLDS:
+    return "Book has patrons waiting for it";
+  case ERROR_CORRUPT_FILE:
+    return "Data file is damaged";
+  case ERROR_OUT_OF_MEMORY:
+    return "Not enough memory";
   default:
     return "Unknown error";
   }
 }
 
+const char *get_status_name(BookStatus status) {
+  static const char *const names[] = {"Available", "Borrowed"};
+  return names[status == BOOK_BORROWED];
+}
+
 /* String Utilities */
 
 char *stristr(const char *haystack, const char *needle) {
@@ -73,9 +110,44 @@ char *stristr(const char *haystack, const char *needle) {
 
 /* Date Utilities */
 
+/*
+ * Reports format many timestamps that fall on the same few days, so the
+ * calendar part is converted once per day and only the hour and minute are
+ * derived arithmetically. Days that are not exactly 24h long (DST switches)
+ * are never cached and go through localtime every time.
+ */
+static _Thread_local time_t cached_day_start = 0;
+static _Thread_local time_t cached_day_end = 0;
+static _Thread_local char cached_day[DATE_LENGTH];
+
 void format_time(time_t time_val, char *buffer, size_t size) {
-  struct tm *tm_info = localtime(&time_val);
-  strftime(buffer, size, "%Y-%m-%d %H:%M", tm_info);
+  if (time_val < cached_day_start || time_val >= cached_day_end) {
+    struct tm tm_info;
+    localtime_r(&time_val, &tm_info);
+    strftime(cached_day, sizeof(cached_day), "%Y-%m-%d", &tm_info);
+
+    tm_info.tm_hour = 0;
+    tm_info.tm_min = 0;
+    tm_info.tm_sec = 0;
+    tm_info.tm_isdst = -1;
+    time_t day_start = mktime(&tm_info);
+    tm_info.tm_mday++;
+    tm_info.tm_isdst = -1;
+    time_t day_end = mktime(&tm_info);
+
+    if (day_end - day_start != 24 * 60 * 60) {
+      cached_day_start = cached_day_end = 0;
+      localtime_r(&time_val, &tm_info);
+      strftime(buffer, size, "%Y-%m-%d %H:%M", &tm_info);
+      return;
+    }
+    cached_day_start = day_start;
+    cached_day_end = day_end;
+  }
+
+  long seconds = (long)(time_val - cached_day_start);
+  snprintf(buffer, size, "%s %02ld:%02ld", cached_day, seconds / 3600,
+           (seconds / 60) % 60);
 }
 
 time_t calculate_due_date(time_t borrow_date, int days) {
@@ -164,114 +236,231 @@ void get_string_input(char *buffer, int size, const char *prompt) {
   }
 }
 
+/* Dirty Tracking */
+
+static void set_bits(unsigned int *bitmap, int from, int to) {
+  for (int i = from; i < to; i++) {
+    bitmap[i / 32] |= 1u << (i % 32);
+  }
+}
+
+void mark_book_dirty(Library *lib, int index) {
+  set_bits(lib->book_dirty, index, index + 1);
+  library_touch(lib);
+}
+
+void mark_books_dirty(Library *lib, int from, int to) {
+  set_bits(lib->book_dirty, from, to);
+  library_touch(lib);
+}
+
+void mark_user_dirty(Library *lib, int index) {
+  set_bits(lib->user_dirty, index, index + 1);
+  library_touch(lib);
+}
+
+void mark_users_dirty(Library *lib, int from, int to) {
+  set_bits(lib->user_dirty, from, to);
+  library_touch(lib);
+}
+
+void mark_all_dirty(Library *lib) {
+  set_bits(lib->book_dirty, 0, MAX_BOOKS);
+  set_bits(lib->user_dirty, 0, MAX_USERS);
+}
+
+void clear_dirty(Library *lib) {
+  memset(lib->book_dirty, 0, sizeof(lib->book_dirty));
+  memset(lib->user_dirty, 0, sizeof(lib->user_dirty));
+}
+
+bool any_dirty(const unsigned int *bitmap, int from, int to) {
+  for (int i = from; i < to; i++) {
+    if (bitmap[i / 32] & (1u << (i % 32))) {
+      return true;
+    }
+  }
+  return false;
+}
+
 /* File I/O Functions */
 
-ErrorCode save_library_to_file(Library *lib, const char *filename) {
-  FILE *file = fopen(filename, "w");
-  if (file == NULL) {
+void write_book_record(FILE *file, const Book *book) {
+  fprintf(file, "BOOK|%d|%s|%s|%s|%d|%d\n", book->id, book->title,
+          book->author, book->genre, book->status, book->borrower_id);
+}
+
+void write_user_record(FILE *file, const User *user) {
+  fprintf(file, "USER|%d|%s|%d", user->id, user->name, user->borrowed_count);
+
+  for (int j = 0; j < user->borrowed_count; j++) {
+    fprintf(file, "|%d|%ld", user->borrowed_book_ids[j],
+            (long)user->borrow_dates[j]);
+  }
+  fprintf(file, "\n");
+}
+
+void parse_book_record(char *line, Book *book) {
+  char *saveptr;
+  char *token = strtok_r(line, "|", &saveptr);
+  token = strtok_r(NULL, "|", &saveptr); /* ID */
+  book->id = atoi(token);
+
+  token = strtok_r(NULL, "|", &saveptr); /* Title */
+  strncpy(book->title, token, MAX_TITLE_LENGTH - 1);
+  book->title[MAX_TITLE_LENGTH - 1] = '\0';
+
+  token = strtok_r(NULL, "|", &saveptr); /* Author */
+  strncpy(book->author, token, MAX_AUTHOR_LENGTH - 1);
+  book->author[MAX_AUTHOR_LENGTH - 1] = '\0';
+
+  token = strtok_r(NULL, "|", &saveptr); /* Genre */
+  strncpy(book->genre, token, MAX_GENRE_LENGTH - 1);
+  book->genre[MAX_GENRE_LENGTH - 1] = '\0';
+
+  token = strtok_r(NULL, "|", &saveptr); /* Status */
+  book->status = atoi(token);
+
+  token = strtok_r(NULL, "|\n", &saveptr); /* Borrower ID */
+  book->borrower_id = atoi(token);
+
+  /* Queues are linked up again from the HOLD records */
+  book->hold_head = NO_HOLD;
+  book->hold_tail = NO_HOLD;
+}
+
+void parse_user_record(char *line, User *user) {
+  char *saveptr;
+  char *token = strtok_r(line, "|", &saveptr);
+  token = strtok_r(NULL, "|", &saveptr); /* ID */
+  user->id = atoi(token);
+
+  token = strtok_r(NULL, "|", &saveptr); /* Name */
+  strncpy(user->name, token, MAX_NAME_LENGTH - 1);
+  user->name[MAX_NAME_LENGTH - 1] = '\0';
+
+  token = strtok_r(NULL, "|", &saveptr); /* Borrowed count */
+  user->borrowed_count = atoi(token);
+
+  for (int j = 0; j < user->borrowed_count; j++) {
+    token = strtok_r(NULL, "|", &saveptr); /* Book ID */
+    user->borrowed_book_ids[j] = atoi(token);
+
+    token = strtok_r(NULL, "|\n", &saveptr); /* Borrow date */
+    user->borrow_dates[j] = (time_t)atol(token);
+  }
+}
+
+static ErrorCode save_text_file(Library *lib, const char *filename) {
+  AtomicFile file;
+  FILE *stream = atomic_file_begin(&file, filename);
+  if (stream == NULL) {
     return ERROR_FILE_IO;
   }
 
   /* Save metadata */
-  fprintf(file, "%d %d %d %d\n", lib->book_count, lib->next_book_id,
+  fprintf(stream, "%d %d %d %d\n", lib->book_count, lib->next_book_id,
           lib->user_count, lib->next_user_id);
 
   /* Save books */
   for (int i = 0; i < lib->book_count; i++) {
-    fprintf(file, "BOOK|%d|%s|%s|%s|%d|%d\n", lib->books[i].id,
-            lib->books[i].title, lib->books[i].author, lib->books[i].genre,
-            lib->books[i].status, lib->books[i].borrower_id);
+    write_book_record(stream, &lib->books[i]);
   }
 
   /* Save users */
   for (int i = 0; i < lib->user_count; i++) {
-    fprintf(file, "USER|%d|%s|%d", lib->users[i].id, lib->users[i].name,
-            lib->users[i].borrowed_count);
-
-    for (int j = 0; j < lib->users[i].borrowed_count; j++) {
-      fprintf(file, "|%d|%ld", lib->users[i].borrowed_book_ids[j],
-              (long)lib->users[i].borrow_dates[j]);
-    }
-    fprintf(file, "\n");
+    write_user_record(stream, &lib->users[i]);
   }
 
-  fclose(file);
+  /* Save hold queues and circulation statistics */
+  write_hold_records(stream, lib);
+  write_circulation_records(stream, &lib->circulation);
+
+  if (atomic_file_commit(&file, NULL) != SUCCESS) {
+    return ERROR_FILE_IO;
+  }
+  clear_dirty(lib);
   return SUCCESS;
 }
 
+/* A ".lbz" name always gets a compressed snapshot; otherwise the library
+ * keeps the layout it was loaded from (segmented for new libraries) */
+ErrorCode save_library_to_file(Library *lib, const char *filename) {
+  if (is_snapshot_filename(filename) || lib->format == FORMAT_COMPRESSED) {
+    return save_compressed_library(lib, filename);
+  }
+  if (lib->format == FORMAT_SEGMENTED) {
+    return checkpoint_library(lib, filename);
+  }
+  return save_text_file(lib, filename);
+}
+
 ErrorCode load_library_from_file(Library *lib, const char *filename) {
-  FILE *file = fopen(filename, "r");
-  if (file == NULL) {
+  FILE *probe = fopen(filename, "r");
+  if (probe == NULL) {
     /* File doesn't exist yet, not an error */
     return SUCCESS;
   }
+  fclose(probe);
+
+  /* Files written before checksums existed have no trailer */
+  char *data;
+  size_t size;
+  ErrorCode result = read_checked_file(filename, false, &data, &size, NULL);
+  if (result != SUCCESS) {
+    return result;
+  }
+
+  if (size >= 4 && memcmp(data, SNAPSHOT_MAGIC, 4) == 0) {
+    result = load_compressed_library(lib, data, size);
+    free(data);
+    return result;
+  }
+
+  char *cursor = data;
+  char *line = next_line(&cursor);
+  if (line != NULL &&
+      strncmp(line, SEGMENT_MAGIC, strlen(SEGMENT_MAGIC)) == 0) {
+    free(data);
+    return load_segmented_library(lib, filename);
+  }
 
   /* Load metadata */
-  if (fscanf(file, "%d %d %d %d\n", &lib->book_count, &lib->next_book_id,
+  if (line == NULL ||
+      sscanf(line, "%d %d %d %d", &lib->book_count, &lib->next_book_id,
              &lib->user_count, &lib->next_user_id) != 4) {
-    fclose(file);
-    return ERROR_FILE_IO;
+    free(data);
+    return ERROR_CORRUPT_FILE;
   }
 
-  char line[512];
   int book_idx = 0;
   int user_idx = 0;
+  clear_holds(lib);
+  clear_circulation(&lib->circulation);
 
-  while (fgets(line, sizeof(line), file)) {
-    if (strncmp(line, "BOOK|", 5) == 0) {
+  while ((line = next_line(&cursor)) != NULL) {
+    if (strncmp(line, "BOOK|", 5) == 0 && book_idx < MAX_BOOKS) {
       /* Parse book */
-      Book *book = &lib->books[book_idx];
-
-      char *token = strtok(line, "|");
-      token = strtok(NULL, "|"); /* ID */
-      book->id = atoi(token);
-
-      token = strtok(NULL, "|"); /* Title */
-      strncpy(book->title, token, MAX_TITLE_LENGTH - 1);
-      book->title[MAX_TITLE_LENGTH - 1] = '\0';
-
-      token = strtok(NULL, "|"); /* Author */
-      strncpy(book->author, token, MAX_AUTHOR_LENGTH - 1);
-      book->author[MAX_AUTHOR_LENGTH - 1] = '\0';
-
-      token = strtok(NULL, "|"); /* Genre */
-      strncpy(book->genre, token, MAX_GENRE_LENGTH - 1);
-      book->genre[MAX_GENRE_LENGTH - 1] = '\0';
-
-      token = strtok(NULL, "|"); /* Status */
-      book->status = atoi(token);
-
-      token = strtok(NULL, "|\n"); /* Borrower ID */
-      book->borrower_id = atoi(token);
-
+      parse_book_record(line, &lib->books[book_idx]);
       book_idx++;
-    } else if (strncmp(line, "USER|", 5) == 0) {
+    } else if (strncmp(line, "USER|", 5) == 0 && user_idx < MAX_USERS) {
       /* Parse user */
-      User *user = &lib->users[user_idx];
-
-      char *token = strtok(line, "|");
-      token = strtok(NULL, "|"); /* ID */
-      user->id = atoi(token);
-
-      token = strtok(NULL, "|"); /* Name */
-      strncpy(user->name, token, MAX_NAME_LENGTH - 1);
-      user->name[MAX_NAME_LENGTH - 1] = '\0';
-
-      token = strtok(NULL, "|"); /* Borrowed count */
-      user->borrowed_count = atoi(token);
-
-      for (int j = 0; j < user->borrowed_count; j++) {
-        token = strtok(NULL, "|"); /* Book ID */
-        user->borrowed_book_ids[j] = atoi(token);
-
-        token = strtok(NULL, "|\n"); /* Borrow date */
-        user->borrow_dates[j] = (time_t)atol(token);
-      }
-
+      parse_user_record(line, &lib->users[user_idx]);
       user_idx++;
+    } else if (strncmp(line, "HOLD|", 5) == 0) {
+      /* Holds follow every book record */
+      parse_hold_record(lib, line);
+    } else {
+      parse_circulation_record(&lib->circulation, line);
     }
   }
 
-  fclose(file);
+  free(data);
+
+  /* Saved back as text; every record counts as changed should it ever be
+   * checkpointed into segments instead */
+  lib->format = FORMAT_TEXT;
+  mark_all_dirty(lib);
+  library_touch(lib);
   return SUCCESS;
 }
@@ -1,6 +1,10 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -20,11 +24,19 @@
 #define DATE_LENGTH 20
 #define BORROW_PERIOD_DAYS 14
 #define NO_BORROWER -1
+#define MAX_HOLDS 200
+#define NO_HOLD -1
+#define TOP_K_SLOTS 16
+#define HISTORY_DAYS 32
 #define FILENAME "library_data.txt"
+#define BOOK_DIRTY_WORDS ((MAX_BOOKS + 31) / 32)
+#define USER_DIRTY_WORDS ((MAX_USERS + 31) / 32)
 
 /* Type Definitions */
 typedef enum { BOOK_AVAILABLE, BOOK_BORROWED } BookStatus;
 
+typedef enum { FORMAT_TEXT, FORMAT_SEGMENTED, FORMAT_COMPRESSED } StorageFormat;
+
 typedef enum {
   SUCCESS,
   ERROR_BOOK_NOT_FOUND,
@@ -36,7 +48,14 @@ typedef enum {
   ERROR_INVALID_INPUT,
   ERROR_USER_BORROW_LIMIT,
   ERROR_FILE_IO,
-  ERROR_OVERDUE_BOOK
+  ERROR_OVERDUE_BOOK,
+  ERROR_BOOK_AVAILABLE,
+  ERROR_ALREADY_ON_HOLD,
+  ERROR_HOLD_NOT_FOUND,
+  ERROR_MAX_HOLDS_REACHED,
+  ERROR_BOOK_HAS_HOLDS,
+  ERROR_CORRUPT_FILE,
+  ERROR_OUT_OF_MEMORY
 } ErrorCode;
 
 typedef struct {
@@ -46,6 +65,8 @@ typedef struct {
   char genre[MAX_GENRE_LENGTH];
   BookStatus status;
   int borrower_id;
+  int hold_head; /* oldest hold in Library.holds, NO_HOLD when none */
+  int hold_tail;
 } Book;
 
 typedef struct {
@@ -56,6 +77,30 @@ typedef struct {
   int borrowed_count;
 } User;
 
+typedef struct {
+  int book_id;
+  int user_id;
+  time_t placed;
+  int next; /* next hold on the same book, or next free entry */
+} HoldEntry;
+
+typedef struct {
+  char key[MAX_TITLE_LENGTH];
+  unsigned long count;
+  unsigned long error; /* count may overstate the true value by this much */
+} TopKEntry;
+
+typedef struct {
+  TopKEntry titles[TOP_K_SLOTS];
+  int title_count;
+  TopKEntry authors[TOP_K_SLOTS];
+  int author_count;
+  long days[HISTORY_DAYS]; /* day number held by each ring slot */
+  unsigned int checkouts[HISTORY_DAYS];
+  unsigned int returns[HISTORY_DAYS];
+  unsigned long total_checkouts;
+} CirculationStats;
+
 typedef struct {
   Book books[MAX_BOOKS];
   int book_count;
@@ -63,23 +108,46 @@ typedef struct {
   User users[MAX_USERS];
   int user_count;
   int next_user_id;
+  unsigned long generation; /* bumped on every mutation */
+  StorageFormat format;     /* layout used by save_library_to_file */
+  unsigned int book_dirty[BOOK_DIRTY_WORDS]; /* slots changed since save */
+  unsigned int user_dirty[USER_DIRTY_WORDS];
+  HoldEntry holds[MAX_HOLDS]; /* pooled entries of every hold queue */
+  int hold_free;              /* first unused entry, NO_HOLD when full */
+  int hold_count;
+  CirculationStats circulation; /* saved with the catalog */
 } Library;
 
 /* Utility Functions */
 void init_library(Library *lib);
 int generate_book_id(Library *lib);
 int generate_user_id(Library *lib);
+void library_touch(Library *lib);
 bool is_valid_string(const char *str);
 const char *get_error_message(ErrorCode error);
+const char *get_status_name(BookStatus status);
 
 /* Input Handling */
 int get_integer_input(const char *prompt, int min, int max);
 void get_string_input(char *buffer, int size, const char *prompt);
 void clear_input_buffer(void);
 
+/* Dirty Tracking */
+void mark_book_dirty(Library *lib, int index);
+void mark_books_dirty(Library *lib, int from, int to);
+void mark_user_dirty(Library *lib, int index);
+void mark_users_dirty(Library *lib, int from, int to);
+void mark_all_dirty(Library *lib);
+void clear_dirty(Library *lib);
+bool any_dirty(const unsigned int *bitmap, int from, int to);
+
 /* File I/O */
 ErrorCode save_library_to_file(Library *lib, const char *filename);
 ErrorCode load_library_from_file(Library *lib, const char *filename);
+void write_book_record(FILE *file, const Book *book);
+void write_user_record(FILE *file, const User *user);
+void parse_book_record(char *line, Book *book);
+void parse_user_record(char *line, User *user);
 
 /* Date Utilities */
 void format_time(time_t time_val, char *buffer, size_t size);
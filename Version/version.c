@@ -0,0 +1,141 @@
+#include "version.h"
+
+#include <sched.h>
+
+/*
+ * Multi-version reads with epoch-based reclamation. Writers serialize on a
+ * lock, copy the current version, mutate the copy with the ordinary
+ * functions and publish it with one atomic pointer swap, so a reader never
+ * sees delete_book shifting the arrays under it. A reader claims a slot
+ * holding the global epoch it started in and then loads the current
+ * version. A replaced version is tagged with the epoch in which it was
+ * unpublished and freed once every active reader started in a later epoch;
+ * readers pinned in that epoch or earlier may still be looking at it.
+ */
+
+ErrorCode init_versioned_library(VersionedLibrary *versions,
+                                 const Library *initial) {
+  Library *lib = malloc(sizeof(Library));
+  if (lib == NULL) {
+    return ERROR_FILE_IO;
+  }
+  *lib = *initial;
+
+  atomic_init(&versions->current, lib);
+  atomic_init(&versions->global_epoch, 1);
+  for (int i = 0; i < MAX_READERS; i++) {
+    atomic_init(&versions->reader_epochs[i], 0);
+  }
+  pthread_mutex_init(&versions->write_lock, NULL);
+  versions->retired = NULL;
+  versions->retired_count = 0;
+  versions->retired_capacity = 0;
+  return SUCCESS;
+}
+
+void free_versioned_library(VersionedLibrary *versions) {
+  for (int i = 0; i < versions->retired_count; i++) {
+    free(versions->retired[i].lib);
+  }
+  free(versions->retired);
+  free(atomic_load(&versions->current));
+  pthread_mutex_destroy(&versions->write_lock);
+}
+
+ErrorCode read_begin(VersionedLibrary *versions, ReadSnapshot *snapshot) {
+  unsigned long epoch = atomic_load(&versions->global_epoch);
+
+  for (int slot = 0; slot < MAX_READERS; slot++) {
+    unsigned long expected = 0;
+    if (atomic_compare_exchange_strong(&versions->reader_epochs[slot],
+                                       &expected, epoch)) {
+      snapshot->slot = slot;
+      snapshot->lib = atomic_load(&versions->current);
+      return SUCCESS;
+    }
+  }
+
+  snapshot->slot = -1;
+  snapshot->lib = NULL;
+  return ERROR_INVALID_INPUT; /* all reader slots busy */
+}
+
+void read_end(VersionedLibrary *versions, ReadSnapshot *snapshot) {
+  if (snapshot->slot >= 0) {
+    atomic_store(&versions->reader_epochs[snapshot->slot], 0);
+  }
+  snapshot->slot = -1;
+  snapshot->lib = NULL;
+}
+
+Library *write_begin(VersionedLibrary *versions) {
+  pthread_mutex_lock(&versions->write_lock);
+
+  Library *next = malloc(sizeof(Library));
+  if (next == NULL) {
+    pthread_mutex_unlock(&versions->write_lock);
+    return NULL;
+  }
+  *next = *atomic_load(&versions->current);
+  return next;
+}
+
+void write_abort(VersionedLibrary *versions, Library *next) {
+  free(next);
+  pthread_mutex_unlock(&versions->write_lock);
+}
+
+static unsigned long oldest_reader_epoch(VersionedLibrary *versions) {
+  unsigned long oldest = atomic_load(&versions->global_epoch);
+  for (int slot = 0; slot < MAX_READERS; slot++) {
+    unsigned long epoch = atomic_load(&versions->reader_epochs[slot]);
+    if (epoch != 0 && epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+  return oldest;
+}
+
+static void reclaim(VersionedLibrary *versions) {
+  unsigned long oldest = oldest_reader_epoch(versions);
+  int kept = 0;
+  for (int i = 0; i < versions->retired_count; i++) {
+    if (versions->retired[i].epoch < oldest) {
+      free(versions->retired[i].lib);
+    } else {
+      versions->retired[kept++] = versions->retired[i];
+    }
+  }
+  versions->retired_count = kept;
+}
+
+void write_commit(VersionedLibrary *versions, Library *next) {
+  Library *old = atomic_exchange(&versions->current, next);
+  unsigned long epoch = atomic_fetch_add(&versions->global_epoch, 1);
+
+  if (versions->retired_count == versions->retired_capacity) {
+    int capacity =
+        versions->retired_capacity == 0 ? 8 : versions->retired_capacity * 2;
+    RetiredVersion *grown =
+        realloc(versions->retired, sizeof(RetiredVersion) * (size_t)capacity);
+    if (grown != NULL) {
+      versions->retired = grown;
+      versions->retired_capacity = capacity;
+    }
+  }
+
+  if (versions->retired_count < versions->retired_capacity) {
+    versions->retired[versions->retired_count].lib = old;
+    versions->retired[versions->retired_count].epoch = epoch;
+    versions->retired_count++;
+  } else {
+    /* Out of memory for the list: wait for readers of this epoch */
+    while (oldest_reader_epoch(versions) <= epoch) {
+      sched_yield();
+    }
+    free(old);
+  }
+
+  reclaim(versions);
+  pthread_mutex_unlock(&versions->write_lock);
+}
@@ -0,0 +1,47 @@
+#ifndef VERSION_H
+#define VERSION_H
+
+#include "../Utils/utils.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Versioning Constants */
+#define MAX_READERS 64
+
+/* Type Definitions */
+typedef struct {
+  Library *lib;
+  unsigned long epoch;
+} RetiredVersion;
+
+typedef struct {
+  _Atomic(Library *) current;
+  atomic_ulong global_epoch;
+  atomic_ulong reader_epochs[MAX_READERS]; /* 0 = slot free */
+  pthread_mutex_t write_lock;
+  RetiredVersion *retired;
+  int retired_count;
+  int retired_capacity;
+} VersionedLibrary;
+
+typedef struct {
+  const Library *lib;
+  int slot;
+} ReadSnapshot;
+
+/* Versioned Library Functions */
+ErrorCode init_versioned_library(VersionedLibrary *versions,
+                                 const Library *initial);
+void free_versioned_library(VersionedLibrary *versions);
+
+/* Readers: pin an epoch and see one consistent version */
+ErrorCode read_begin(VersionedLibrary *versions, ReadSnapshot *snapshot);
+void read_end(VersionedLibrary *versions, ReadSnapshot *snapshot);
+
+/* Writers: mutate a private copy, then publish it */
+Library *write_begin(VersionedLibrary *versions);
+void write_commit(VersionedLibrary *versions, Library *next);
+void write_abort(VersionedLibrary *versions, Library *next);
+
+#endif /* VERSION_H */
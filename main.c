@@ -1,5 +1,13 @@
+#include "Batch/batch.h"
 #include "Book/book.h"
+#include "Dedupe/dedupe.h"
+#include "Hold/hold.h"
 #include "Management/management.h"
+#include "Parallel/parallel.h"
+#include "Persist/persist.h"
+#include "Replica/replica.h"
+#include "Shared/shared.h"
+#include "Trace/trace.h"
 #include "User/user.h"
 #include "Utils/utils.h"
 
@@ -27,31 +35,307 @@ void print_menu() {
   printf(" 15. Display all users\n");
   printf(" 16. Display statistics\n");
   printf(" 17. Display overdue books\n");
+  printf(" 18. Export report (CSV/JSON)\n");
+  printf(" 19. Save snapshot to file (.lbz = compressed)\n");
+  printf(" 20. Borrow/return several books at once\n");
+  printf(" 21. Place hold\n");
+  printf(" 22. Cancel hold\n");
+  printf(" 23. Display hold queue\n");
+  printf(" 24. Find duplicate books\n");
   printf(" 0. Exit\n");
   printf("========================================\n");
 }
 
-int main() {
+void print_usage(const char *program) {
+  printf("Usage: %s [--record TRACE] [--primary SOCKET | --shared NAME]\n",
+         program);
+  printf("       %s --replay TRACE [--threads N] [--paced]\n", program);
+  printf("       %s --follow SOCKET\n", program);
+}
+
+void print_replica_menu() {
+  printf("\n========================================\n");
+  printf("   LIBRARY READ REPLICA\n");
+  printf("========================================\n");
+  printf(" 1. Search books by title\n");
+  printf(" 2. Search books by author\n");
+  printf(" 3. Search books by genre\n");
+  printf(" 4. Display available books\n");
+  printf(" 5. Display user information\n");
+  printf(" 6. Display all books\n");
+  printf(" 7. Display all users\n");
+  printf(" 8. Display statistics\n");
+  printf(" 9. Display overdue books\n");
+  printf(" 10. Replication status\n");
+  printf(" 0. Exit\n");
+  printf("========================================\n");
+}
+
+/* Desks on a shared catalog change it in place under its lock; a desk on
+ * its own changes its library and queues a save */
+Library *begin_change(Library *local, SharedLibrary *shared) {
+  if (shared == NULL) {
+    return local;
+  }
+  Library *lib = shared_write_begin(shared);
+  if (lib == NULL) {
+    printf("Error: Shared catalog is unavailable.\n");
+  }
+  return lib;
+}
+
+void end_change(Library *local, SharedLibrary *shared, ErrorCode result) {
+  if (shared == NULL) {
+    if (result == SUCCESS) {
+      persist_submit(local);
+    }
+    return;
+  }
+  shared_write_end(shared);
+  shared_read(shared, local);
+}
+
+/* Serves reads from a copy kept current by the primary's log */
+int run_follower(const char *socket_path) {
+  Library *empty = malloc(sizeof(Library));
+  VersionedLibrary versions;
+  if (empty == NULL) {
+    return 1;
+  }
+  init_library(empty);
+  ErrorCode result = init_versioned_library(&versions, empty);
+  free(empty);
+  if (result != SUCCESS) {
+    printf("Error: %s\n", get_error_message(result));
+    return 1;
+  }
+  if (replica_follow_start(socket_path, &versions) != SUCCESS) {
+    printf("Error: Could not follow %s\n", socket_path);
+    free_versioned_library(&versions);
+    return 1;
+  }
+
+  char text[MAX_TITLE_LENGTH];
+  while (1) {
+    print_replica_menu();
+    int choice = get_integer_input("Choose function: ", 0, 10);
+    if (choice == 0) {
+      break;
+    }
+    if (choice == 10) {
+      display_replica_status();
+      continue;
+    }
+
+    ReadSnapshot snapshot;
+    if (read_begin(&versions, &snapshot) != SUCCESS) {
+      printf("Too many concurrent readers, try again.\n");
+      continue;
+    }
+    /* Reports take a mutable pointer but only read from it */
+    Library *lib = (Library *)snapshot.lib;
+
+    switch (choice) {
+    case 1:
+      get_string_input(text, MAX_TITLE_LENGTH, "Enter title to search: ");
+      search_books_by_title(lib, text);
+      break;
+    case 2:
+      get_string_input(text, MAX_AUTHOR_LENGTH, "Enter author to search: ");
+      search_books_by_author(lib, text);
+      break;
+    case 3:
+      get_string_input(text, MAX_GENRE_LENGTH, "Enter genre to search: ");
+      search_books_by_genre(lib, text);
+      break;
+    case 4:
+      display_available_books(lib);
+      break;
+    case 5:
+      display_user_info(lib, get_integer_input("Enter user ID: ", 1, 999999));
+      break;
+    case 6:
+      display_all_books(lib);
+      break;
+    case 7:
+      display_all_users(lib);
+      break;
+    case 8:
+      display_statistics(lib);
+      break;
+    case 9:
+      display_overdue_books(lib);
+      break;
+    default:
+      printf("Invalid choice!\n");
+    }
+    read_end(&versions, &snapshot);
+  }
+
+  replica_follow_stop();
+  pool_stop();
+  free_versioned_library(&versions);
+  return 0;
+}
+
+void add_sample_data(Library *lib) {
+  add_book(lib, "Clean Code", "Robert C. Martin", "Programming");
+  add_book(lib, "Design Patterns", "Gang of Four", "Programming");
+  add_book(lib, "The Pragmatic Programmer", "Andrew Hunt", "Programming");
+  add_user(lib, "John Doe");
+  add_user(lib, "Jane Smith");
+  printf("Sample data added.\n");
+}
+
+/* Starting fresh would save over the only copy of the damaged catalog */
+void print_corrupt_file(const char *filename) {
+  printf("Error: %s is damaged (checksum mismatch or torn write).\n",
+         filename);
+  printf("Move it and its segment files aside to start fresh.\n");
+}
+
+/* Replays a recorded trace against the loaded library; nothing is saved */
+int run_replay(const Library *library, const char *path, int threads,
+               bool paced) {
+  TraceRecord *records;
+  int count;
+  if (load_trace(path, &records, &count) != SUCCESS) {
+    printf("Error: Could not read trace %s\n", path);
+    return 1;
+  }
+
+  ReplayReport report;
+  ErrorCode result =
+      replay_trace(library, records, count, threads, paced, &report);
+  free(records);
+  if (result != SUCCESS) {
+    printf("Error: %s\n", get_error_message(result));
+    return 1;
+  }
+  display_replay_report(&report, threads);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *record_path = NULL;
+  const char *replay_path = NULL;
+  const char *primary_path = NULL;
+  const char *shared_name = NULL;
+  int replay_threads = 1;
+  bool paced = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      record_path = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else if (strcmp(argv[i], "--primary") == 0 && i + 1 < argc) {
+      primary_path = argv[++i];
+    } else if (strcmp(argv[i], "--shared") == 0 && i + 1 < argc) {
+      shared_name = argv[++i];
+    } else if (strcmp(argv[i], "--follow") == 0 && i + 1 < argc) {
+      return run_follower(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      replay_threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--paced") == 0) {
+      paced = true;
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (primary_path != NULL && shared_name != NULL) {
+    /* The log would miss changes made by the other desks */
+    print_usage(argv[0]);
+    return 1;
+  }
+
   Library library;
   init_library(&library);
 
-  /* Load data from file */
-  ErrorCode load_result = load_library_from_file(&library, FILENAME);
-  if (load_result == SUCCESS) {
-    printf("Library data loaded successfully!\n");
-  } else if (load_result == ERROR_FILE_IO) {
-    printf("Warning: Could not load library data. Starting fresh.\n");
+  /* A desk joining a shared catalog takes it from the segment; only the
+   * desk that creates the segment reads the data file, straight into it */
+  SharedLibrary shared_library;
+  SharedLibrary *shared = NULL;
+  ErrorCode load_result;
+  if (shared_name != NULL && replay_path == NULL) {
+    load_result = shared_library_open(&shared_library, shared_name, FILENAME);
+    if (load_result == ERROR_CORRUPT_FILE) {
+      print_corrupt_file(FILENAME);
+      return 1;
+    }
+    if (load_result != SUCCESS) {
+      printf("Error: Could not open shared catalog %s\n", shared_name);
+      return 1;
+    }
+    shared = &shared_library;
+    load_result = shared->created ? shared->load_result : SUCCESS;
+    shared_read(shared, &library);
+  } else {
+    load_result = load_library_from_file(&library, FILENAME);
+    if (load_result == ERROR_CORRUPT_FILE) {
+      print_corrupt_file(FILENAME);
+      return 1;
+    }
+    if (load_result == ERROR_FILE_IO) {
+      init_library(&library);
+    }
+  }
+
+  if (shared == NULL || shared->created) {
+    if (load_result == SUCCESS) {
+      printf("Library data loaded successfully!\n");
+    } else if (load_result == ERROR_FILE_IO) {
+      printf("Warning: Could not load library data. Starting fresh.\n");
+    }
+  }
+  if (shared != NULL) {
+    printf("%s shared catalog %s.\n", shared->created ? "Created" : "Joined",
+           shared->name);
   }
 
   /* Add sample data if library is empty */
-  if (library.book_count == 0) {
-    add_book(&library, "Clean Code", "Robert C. Martin", "Programming");
-    add_book(&library, "Design Patterns", "Gang of Four", "Programming");
-    add_book(&library, "The Pragmatic Programmer", "Andrew Hunt",
-             "Programming");
-    add_user(&library, "John Doe");
-    add_user(&library, "Jane Smith");
-    printf("Sample data added.\n");
+  if (shared == NULL) {
+    if (library.book_count == 0) {
+      add_sample_data(&library);
+    }
+  } else if (shared->created) {
+    Library *lib = shared_write_begin(shared);
+    if (lib != NULL) {
+      if (lib->book_count == 0) {
+        add_sample_data(lib);
+      }
+      shared_write_end(shared);
+      shared_read(shared, &library);
+    }
+  }
+
+  /* Worker pool for large scans, started by the first one that needs it */
+  const char *threads = getenv("LIBRARY_THREADS");
+  const char *threshold = getenv("LIBRARY_PARALLEL_THRESHOLD");
+  pool_configure(threads != NULL ? atoi(threads) : 0);
+  if (threshold != NULL) {
+    parallel_set_threshold(atoi(threshold));
+  }
+
+  if (replay_path != NULL) {
+    int status = run_replay(&library, replay_path, replay_threads, paced);
+    pool_stop();
+    return status;
+  }
+
+  if (record_path != NULL && trace_start(record_path) != SUCCESS) {
+    printf("Warning: Could not record to %s.\n", record_path);
+  }
+
+  if (primary_path != NULL &&
+      replica_primary_start(primary_path, &library) != SUCCESS) {
+    printf("Warning: Could not serve replicas on %s.\n", primary_path);
+  }
+
+  /* Saves happen on a background thread from here on */
+  if (shared == NULL && persist_start(FILENAME) != SUCCESS) {
+    printf("Warning: Background saving unavailable, saving inline.\n");
   }
 
   int choice;
@@ -59,22 +343,28 @@ int main() {
   char author[MAX_AUTHOR_LENGTH];
   char genre[MAX_GENRE_LENGTH];
   char name[MAX_NAME_LENGTH];
+  char path[MAX_TITLE_LENGTH];
   int id, book_id, user_id;
   ErrorCode result;
+  Library *lib;
 
   while (1) {
     print_menu();
-    choice = get_integer_input("Choose function: ", 0, 17);
+    choice = get_integer_input("Choose function: ", 0, 24);
+    if (shared != NULL) {
+      shared_read(shared, &library); /* see the other desks' changes */
+    }
 
     switch (choice) {
     case 1:
       get_string_input(title, MAX_TITLE_LENGTH, "Enter title: ");
       get_string_input(author, MAX_AUTHOR_LENGTH, "Enter author: ");
       get_string_input(genre, MAX_GENRE_LENGTH, "Enter genre: ");
-      result = add_book(&library, title, author, genre);
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = add_book(lib, title, author, genre);
+      end_change(&library, shared, result);
       printf("%s\n", get_error_message(result));
-      if (result == SUCCESS)
-        save_library_to_file(&library, FILENAME);
       break;
 
     case 2:
@@ -82,61 +372,75 @@ int main() {
       get_string_input(title, MAX_TITLE_LENGTH, "Enter new title: ");
       get_string_input(author, MAX_AUTHOR_LENGTH, "Enter new author: ");
       get_string_input(genre, MAX_GENRE_LENGTH, "Enter new genre: ");
-      result = update_book(&library, id, title, author, genre);
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = update_book(lib, id, title, author, genre);
+      end_change(&library, shared, result);
       printf("%s\n", get_error_message(result));
-      if (result == SUCCESS)
-        save_library_to_file(&library, FILENAME);
       break;
 
     case 3:
       id = get_integer_input("Enter book ID to delete: ", 1, 999999);
-      result = delete_book(&library, id);
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = delete_book(lib, id);
+      end_change(&library, shared, result);
       printf("%s\n", get_error_message(result));
-      if (result == SUCCESS)
-        save_library_to_file(&library, FILENAME);
       break;
 
     case 4:
       get_string_input(name, MAX_NAME_LENGTH, "Enter user name: ");
-      result = add_user(&library, name);
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = add_user(lib, name);
+      end_change(&library, shared, result);
       printf("%s\n", get_error_message(result));
-      if (result == SUCCESS)
-        save_library_to_file(&library, FILENAME);
       break;
 
     case 5:
       id = get_integer_input("Enter user ID: ", 1, 999999);
       get_string_input(name, MAX_NAME_LENGTH, "Enter new name: ");
-      result = update_user(&library, id, name);
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = update_user(lib, id, name);
+      end_change(&library, shared, result);
       printf("%s\n", get_error_message(result));
-      if (result == SUCCESS)
-        save_library_to_file(&library, FILENAME);
       break;
 
     case 6:
       id = get_integer_input("Enter user ID to delete: ", 1, 999999);
-      result = delete_user(&library, id);
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = delete_user(lib, id);
+      end_change(&library, shared, result);
       printf("%s\n", get_error_message(result));
-      if (result == SUCCESS)
-        save_library_to_file(&library, FILENAME);
       break;
 
     case 7:
       user_id = get_integer_input("Enter user ID: ", 1, 999999);
       book_id = get_integer_input("Enter book ID: ", 1, 999999);
-      result = borrow_book(&library, user_id, book_id);
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = borrow_book(lib, user_id, book_id);
+      end_change(&library, shared, result);
       printf("%s\n", get_error_message(result));
-      if (result == SUCCESS)
-        save_library_to_file(&library, FILENAME);
       break;
 
     case 8:
       user_id = get_integer_input("Enter user ID: ", 1, 999999);
       book_id = get_integer_input("Enter book ID: ", 1, 999999);
-      result = return_book(&library, user_id, book_id);
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = return_book(lib, user_id, book_id);
+      end_change(&library, shared, result);
       printf("%s\n", get_error_message(result));
-      if (result == SUCCESS)
-        save_library_to_file(&library, FILENAME);
+      if (result == SUCCESS) {
+        Book *book = find_book_by_id(&library, book_id);
+        if (book != NULL && book->status == BOOK_BORROWED) {
+          printf("Book passed on to user %d from the hold queue.\n",
+                 book->borrower_id);
+        }
+      }
       break;
 
     case 9:
@@ -173,20 +477,119 @@ int main() {
 
     case 16:
       display_statistics(&library);
+      if (shared != NULL) {
+        display_shared_status(shared);
+      }
       break;
 
     case 17:
       display_overdue_books(&library);
       break;
 
+    case 18:
+      id = get_integer_input(
+          "Report (1=All books, 2=Available, 3=Users, 4=Overdue, "
+          "5=Duplicates): ",
+          1, 5);
+      choice = get_integer_input("Format (1=CSV, 2=JSON): ", 1, 2);
+      get_string_input(path, MAX_TITLE_LENGTH, "Enter output file: ");
+      result = export_report(&library, (ReportKind)(id - 1),
+                             choice == 1 ? OUTPUT_CSV : OUTPUT_JSON, path);
+      printf("%s\n", get_error_message(result));
+      break;
+
+    case 19: {
+      /* Saving clears dirty bits, so work on a copy */
+      get_string_input(path, MAX_TITLE_LENGTH, "Enter snapshot file: ");
+      Library snapshot = library;
+      snapshot.format = FORMAT_TEXT;
+      result = save_library_to_file(&snapshot, path);
+      printf("%s\n", get_error_message(result));
+      break;
+    }
+
+    case 20: {
+      OperationBatch batch;
+      int failed;
+      init_batch(&batch);
+      user_id = get_integer_input("Enter user ID: ", 1, 999999);
+      choice = get_integer_input("Operation (1=Borrow, 2=Return): ", 1, 2);
+      id = get_integer_input("Number of books: ", 1, MAX_BATCH_OPERATIONS);
+      for (int i = 0; i < id; i++) {
+        book_id = get_integer_input("Enter book ID: ", 1, 999999);
+        if (choice == 1) {
+          batch_borrow(&batch, user_id, book_id);
+        } else {
+          batch_return(&batch, user_id, book_id);
+        }
+      }
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = commit_batch(lib, &batch, &failed);
+      end_change(&library, shared, result);
+      if (result == SUCCESS) {
+        printf("%s\n", get_error_message(result));
+      } else if (failed >= 0) {
+        printf("Book ID %d: %s. No changes were made.\n",
+               batch.operations[failed].book_id, get_error_message(result));
+      } else {
+        printf("%s\n", get_error_message(result));
+      }
+      break;
+    }
+
+    case 21:
+      user_id = get_integer_input("Enter user ID: ", 1, 999999);
+      book_id = get_integer_input("Enter book ID: ", 1, 999999);
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = place_hold(lib, user_id, book_id);
+      end_change(&library, shared, result);
+      printf("%s\n", get_error_message(result));
+      break;
+
+    case 22:
+      user_id = get_integer_input("Enter user ID: ", 1, 999999);
+      book_id = get_integer_input("Enter book ID: ", 1, 999999);
+      if ((lib = begin_change(&library, shared)) == NULL)
+        break;
+      result = cancel_hold(lib, user_id, book_id);
+      end_change(&library, shared, result);
+      printf("%s\n", get_error_message(result));
+      break;
+
+    case 23:
+      book_id = get_integer_input("Enter book ID: ", 1, 999999);
+      display_holds(&library, book_id);
+      break;
+
+    case 24:
+      display_duplicate_books(&library);
+      break;
+
     case 0:
-      save_library_to_file(&library, FILENAME);
+      replica_primary_stop();
+      trace_stop();
+      if (shared != NULL) {
+        result = shared_library_close(shared);
+      } else {
+        persist_submit(&library);
+        result = persist_stop();
+      }
+      pool_stop();
+      if (result != SUCCESS) {
+        printf("Error saving data: %s\n", get_error_message(result));
+        return 1;
+      }
       printf("Data saved. Thank you for using the system!\n");
       return 0;
 
     default:
       printf("Invalid choice!\n");
     }
+
+    /* Followers that fall behind the log catch up from this copy */
+    replica_checkpoint(&library);
   }
 
   return 0;
@@ -0,0 +1,155 @@
+#include "../Utils/utils.h"
+#include "../Dedupe/dedupe.h"
+#include "../Parallel/parallel.h"
+
+#include <stdint.h>
+
+/*
+ * Throughput of find_duplicate_books on a synthetic catalog, far beyond
+ * MAX_BOOKS: titles are two to five words made of random syllables, every
+ * tenth record repeats an earlier one with different case and punctuation,
+ * and every tenth is a near copy with one letter changed. Usage:
+ *
+ *   bench_dedupe [records]   (default 1000000)
+ *
+ * Prints the time taken next to the number of planted duplicates, and
+ * fails if any reported near match is below NEAR_DUPLICATE_THRESHOLD.
+ */
+
+#define BENCH_DEFAULT_RECORDS 1000000
+
+static const char *syllables[] = {"ba", "ce", "di", "fo", "gu", "ha", "ke",
+                                  "li", "mo", "nu", "pa", "re", "si", "to",
+                                  "vu", "wa", "xe", "yo", "za", "lor"};
+#define SYLLABLE_COUNT ((int)(sizeof(syllables) / sizeof(syllables[0])))
+
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+/* Appends a word of two to four syllables, preceded by a space if needed */
+static void append_word(char *text, size_t size, uint64_t *state) {
+  size_t length = strlen(text);
+  if (length > 0 && length + 1 < size) {
+    text[length++] = ' ';
+    text[length] = '\0';
+  }
+  int parts = 2 + (int)(next_random(state) % 3);
+  for (int i = 0; i < parts; i++) {
+    const char *syllable = syllables[next_random(state) % SYLLABLE_COUNT];
+    size_t add = strlen(syllable);
+    if (length + add >= size) {
+      return;
+    }
+    memcpy(text + length, syllable, add + 1);
+    length += add;
+  }
+}
+
+/* Returns the number of records planted as duplicates */
+static int make_catalog(Book *books, int count) {
+  uint64_t state = 0x2545f4914f6cdd1du;
+  int planted = 0;
+  for (int i = 0; i < count; i++) {
+    Book *book = &books[i];
+    memset(book, 0, sizeof(*book));
+    book->id = i + 1;
+    book->hold_head = NO_HOLD;
+    book->hold_tail = NO_HOLD;
+    snprintf(book->genre, MAX_GENRE_LENGTH, "Genre %d", i % 7);
+
+    int kind = (int)(next_random(&state) % 10);
+    if (i > 0 && kind == 0) {
+      /* Same key after normalization */
+      Book source = books[next_random(&state) % (uint64_t)i];
+      snprintf(book->title, MAX_TITLE_LENGTH, "%.98s!", source.title);
+      for (char *p = book->title; *p; p++) {
+        *p = (char)toupper((unsigned char)*p);
+      }
+      snprintf(book->author, MAX_AUTHOR_LENGTH, "%s", source.author);
+      planted++;
+    } else if (i > 0 && kind == 1) {
+      /* One letter changed */
+      Book source = books[next_random(&state) % (uint64_t)i];
+      snprintf(book->title, MAX_TITLE_LENGTH, "%s", source.title);
+      snprintf(book->author, MAX_AUTHOR_LENGTH, "%s", source.author);
+      size_t length = strlen(book->title);
+      book->title[next_random(&state) % length] = 'x';
+      planted++;
+    } else {
+      int words = 2 + (int)(next_random(&state) % 4);
+      for (int w = 0; w < words; w++) {
+        append_word(book->title, MAX_TITLE_LENGTH, &state);
+      }
+      append_word(book->author, MAX_AUTHOR_LENGTH, &state);
+      append_word(book->author, MAX_AUTHOR_LENGTH, &state);
+    }
+  }
+  return planted;
+}
+
+static double seconds_since(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv) {
+  int count = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_RECORDS;
+  if (count <= 0) {
+    fprintf(stderr, "usage: %s [records]\n", argv[0]);
+    return 1;
+  }
+
+  Book *books = malloc(sizeof(Book) * (size_t)count);
+  DuplicateMatch *matches = malloc(sizeof(DuplicateMatch) * (size_t)count);
+  if (books == NULL || matches == NULL) {
+    fprintf(stderr, "Not enough memory for %d records\n", count);
+    free(books);
+    free(matches);
+    return 1;
+  }
+  int planted = make_catalog(books, count);
+
+  const char *threads = getenv("LIBRARY_THREADS");
+  pool_configure(threads != NULL ? atoi(threads) : 0);
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int duplicates = 0;
+  ErrorCode result = find_duplicate_books(books, count, matches, &duplicates);
+  double elapsed = seconds_since(&start);
+  if (result != SUCCESS) {
+    fprintf(stderr, "find_duplicate_books: %s\n", get_error_message(result));
+    free(books);
+    free(matches);
+    return 1;
+  }
+
+  int exact = 0;
+  int below = 0;
+  for (int i = 0; i < count; i++) {
+    if (matches[i].keep < 0) {
+      continue;
+    }
+    exact += matches[i].exact;
+    below += matches[i].similarity < NEAR_DUPLICATE_THRESHOLD;
+  }
+
+  printf("%d records: %d duplicates (%d exact, %d near, %d planted) in "
+         "%.2f s, %d worker threads\n",
+         count, duplicates, exact, duplicates - exact, planted, elapsed,
+         pool_worker_count());
+  pool_stop();
+  free(books);
+  free(matches);
+  if (below > 0) {
+    printf("%d matches below the similarity threshold\n", below);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include "../Utils/utils.h"
+#include "../Parallel/parallel.h"
+
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+ * Scaling of parallel_scan from one worker to every CPU. The predicate is
+ * the case-insensitive substring match the title search uses, run over a
+ * synthetic range far beyond MAX_BOOKS. Each configuration is timed over
+ * several scans and compared with a scan on the calling thread alone.
+ * Usage:
+ *
+ *   bench_parallel [records]   (default 1000000)
+ */
+
+#define BENCH_DEFAULT_RECORDS 1000000
+#define BENCH_REPEATS 5
+#define BENCH_TITLE_LENGTH 48
+
+static int mismatches = 0;
+
+typedef struct {
+  char (*titles)[BENCH_TITLE_LENGTH];
+  const char *needle;
+} ScanContext;
+
+static const char *words[] = {"Clean",   "Code",     "Design",  "Patterns",
+                              "Systems", "Practice", "Theory",  "Data",
+                              "Network", "Compiler", "History", "Garden"};
+#define WORD_COUNT ((int)(sizeof(words) / sizeof(words[0])))
+
+static uint64_t next_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static bool title_matches(int index, void *context) {
+  ScanContext *scan = context;
+  return stristr(scan->titles[index], scan->needle) != NULL;
+}
+
+static double seconds_since(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Mean seconds per scan; the match count is checked against the first */
+static double time_scans(int count, ScanContext *scan, int *matches,
+                         int *found) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int r = 0; r < BENCH_REPEATS; r++) {
+    int result = parallel_scan(count, title_matches, scan, matches);
+    if (*found >= 0 && result != *found) {
+      fprintf(stderr, "scan found %d matches, expected %d\n", result, *found);
+      mismatches++;
+    }
+    *found = result;
+  }
+  return seconds_since(&start) / BENCH_REPEATS;
+}
+
+int main(int argc, char **argv) {
+  int count = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_RECORDS;
+  if (count <= 0) {
+    fprintf(stderr, "usage: %s [records]\n", argv[0]);
+    return 1;
+  }
+
+  ScanContext scan = {malloc(BENCH_TITLE_LENGTH * (size_t)count), "pattern"};
+  int *matches = malloc(sizeof(int) * (size_t)count);
+  if (scan.titles == NULL || matches == NULL) {
+    fprintf(stderr, "Not enough memory for %d records\n", count);
+    free(scan.titles);
+    free(matches);
+    return 1;
+  }
+  uint64_t state = 0x9e3779b97f4a7c15u;
+  for (int i = 0; i < count; i++) {
+    snprintf(scan.titles[i], BENCH_TITLE_LENGTH, "%s %s %s %d",
+             words[next_random(&state) % WORD_COUNT],
+             words[next_random(&state) % WORD_COUNT],
+             words[next_random(&state) % WORD_COUNT], i);
+  }
+
+  /* Baseline: below the threshold the scan never touches the pool */
+  int found = -1;
+  parallel_set_threshold(count + 1);
+  double inline_seconds = time_scans(count, &scan, matches, &found);
+  printf("%d records, %d matches\n", count, found);
+  printf("inline     %8.2f ms\n", inline_seconds * 1e3);
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int all = cpus > 0 ? (int)cpus : 1;
+  if (all > POOL_MAX_WORKERS) {
+    all = POOL_MAX_WORKERS;
+  }
+  int sizes[] = {1, 2, 4, all};
+  int size_count = all == 1 || all == 2 || all == 4 ? 3 : 4;
+  int status = 0;
+  parallel_set_threshold(1);
+  for (int s = 0; s < size_count; s++) {
+    if (pool_start(sizes[s]) != SUCCESS) {
+      fprintf(stderr, "Could not start %d workers\n", sizes[s]);
+      status = 1;
+      break;
+    }
+    double seconds = time_scans(count, &scan, matches, &found);
+    printf("%2d workers %8.2f ms  %5.2fx\n", pool_worker_count(),
+           seconds * 1e3, inline_seconds / seconds);
+  }
+  printf("(%d CPUs online)\n", all);
+
+  pool_stop();
+  free(scan.titles);
+  free(matches);
+  return mismatches > 0 ? 1 : status;
+}
@@ -0,0 +1,142 @@
+#include "../Utils/utils.h"
+#include "../Book/book.h"
+#include "../Hold/hold.h"
+#include "../Management/management.h"
+#include "../Storage/snapshot.h"
+#include "../Storage/storage.h"
+#include "../User/user.h"
+
+#include <sys/stat.h>
+
+/*
+ * Size and load time of a full catalog (MAX_BOOKS books, MAX_USERS users,
+ * loans, holds and circulation) saved as a text file and as a compressed
+ * ".lbz" snapshot. Each file is loaded repeatedly and the mean is printed.
+ * Usage:
+ *
+ *   bench_snapshot [loads]   (default 2000)
+ */
+
+#define BENCH_DEFAULT_LOADS 2000
+#define BENCH_BORROWERS 10 /* MAX_BORROWED_BOOKS loans each */
+
+static const char *authors[] = {"Robert C. Martin", "Martin Fowler",
+                                "Kent Beck",        "Andrew Hunt",
+                                "Eric Evans",       "Michael Feathers",
+                                "Donald Knuth",     "Brian Kernighan"};
+static const char *genres[] = {"Programming", "Software", "Computer Science",
+                               "Mathematics", "History"};
+static const char *subjects[] = {"Code",    "Design",  "Patterns",
+                                 "Systems", "Testing", "Algorithms",
+                                 "Objects", "Programs"};
+
+#define COUNT_OF(array) ((int)(sizeof(array) / sizeof(array[0])))
+
+static void build_library(Library *lib) {
+  char title[MAX_TITLE_LENGTH], name[MAX_NAME_LENGTH];
+  init_library(lib);
+  for (int i = 0; i < MAX_BOOKS; i++) {
+    snprintf(title, sizeof(title), "%s of %s, Volume %d",
+             subjects[i % COUNT_OF(subjects)],
+             subjects[(i / COUNT_OF(subjects)) % COUNT_OF(subjects)],
+             i + 1);
+    add_book(lib, title, authors[i % COUNT_OF(authors)],
+             genres[i % COUNT_OF(genres)]);
+  }
+  for (int i = 0; i < MAX_USERS; i++) {
+    snprintf(name, sizeof(name), "Reader %d", i + 1);
+    add_user(lib, name);
+  }
+
+  time_t now = time(NULL);
+  int loans = BENCH_BORROWERS * MAX_BORROWED_BOOKS;
+  for (int i = 0; i < loans; i++) {
+    int book_id = lib->books[i].id;
+    borrow_book_at(lib, lib->users[i % BENCH_BORROWERS].id, book_id,
+                   now - (time_t)i * 24 * 60 * 60);
+    place_hold(lib, lib->users[BENCH_BORROWERS + i % 20].id, book_id);
+  }
+}
+
+static double seconds_since(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Returns the file size, or -1 if it could not be saved or read back */
+static long measure(const char *label, Library *lib, const char *path,
+                    int loads, Library *loaded) {
+  if (save_library_to_file(lib, path) != SUCCESS) {
+    fprintf(stderr, "Could not save %s\n", path);
+    return -1;
+  }
+  struct stat info;
+  if (stat(path, &info) != 0) {
+    return -1;
+  }
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < loads; i++) {
+    init_library(loaded);
+    if (load_library_from_file(loaded, path) != SUCCESS) {
+      fprintf(stderr, "Could not load %s\n", path);
+      return -1;
+    }
+  }
+  double elapsed = seconds_since(&start);
+  if (loaded->book_count != lib->book_count ||
+      loaded->user_count != lib->user_count ||
+      loaded->hold_count != lib->hold_count) {
+    fprintf(stderr, "%s does not load back what was saved\n", path);
+    return -1;
+  }
+
+  printf("%-5s %7ld bytes, load %8.1f us\n", label, (long)info.st_size,
+         elapsed / loads * 1e6);
+  return (long)info.st_size;
+}
+
+int main(int argc, char **argv) {
+  int loads = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_LOADS;
+  char directory[] = "/tmp/bench_snapshot_XXXXXX";
+  if (loads <= 0) {
+    fprintf(stderr, "usage: %s [loads]\n", argv[0]);
+    return 1;
+  }
+  if (mkdtemp(directory) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  Library *lib = malloc(sizeof(Library));
+  Library *loaded = malloc(sizeof(Library));
+  int status = 1;
+  if (lib != NULL && loaded != NULL) {
+    char text[MAX_PATH_LENGTH], snapshot[MAX_PATH_LENGTH];
+    snprintf(text, sizeof(text), "%s/library.txt", directory);
+    snprintf(snapshot, sizeof(snapshot), "%s/library%s", directory,
+             SNAPSHOT_EXTENSION);
+    build_library(lib);
+
+    lib->format = FORMAT_TEXT;
+    long text_size = measure("text", lib, text, loads, loaded);
+    long snapshot_size = measure("lbz", lib, snapshot, loads, loaded);
+    if (text_size > 0 && snapshot_size > 0) {
+      printf("lbz is %.0f%% of the text size (%d loads each)\n",
+             100.0 * (double)snapshot_size / (double)text_size, loads);
+      status = 0;
+    }
+  }
+
+  char command[MAX_PATH_LENGTH + 16];
+  snprintf(command, sizeof(command), "rm -rf '%s'", directory);
+  if (system(command) != 0) {
+    fprintf(stderr, "Could not remove %s\n", directory);
+  }
+  free(lib);
+  free(loaded);
+  return status;
+}
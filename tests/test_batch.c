@@ -0,0 +1,123 @@
+#include "../Utils/utils.h"
+#include "../Batch/batch.h"
+#include "../Book/book.h"
+#include "../Branch/branch.h"
+#include "../Storage/storage.h"
+#include "../User/user.h"
+
+/*
+ * Branch batches: a batch that saves is on disk after a restart, one with
+ * a failing operation changes nothing, and one whose save fails is rolled
+ * back in memory so the branch still matches its data file. Exits non-zero
+ * on the first failed check.
+ */
+
+static int failures = 0;
+static char directory[] = "/tmp/test_batch_XXXXXX";
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+static void path_in(char *buffer, const char *name) {
+  snprintf(buffer, MAX_PATH_LENGTH, "%s/%s", directory, name);
+}
+
+/* One branch backed by the named file, with a book and a patron */
+static Branch *open_branch(BranchNetwork *net, const char *name) {
+  char journal[MAX_PATH_LENGTH], file[MAX_PATH_LENGTH];
+  path_in(journal, "batch.journal");
+  path_in(file, name);
+  init_branch_network(net, journal);
+  CHECK(add_branch(net, "main", 0, file) == SUCCESS);
+  Branch *branch = find_branch(net, "main");
+  if (branch->lib->book_count == 0) {
+    CHECK(add_book(branch->lib, "Clean Code", "Robert C. Martin",
+                   "Programming") == SUCCESS);
+    CHECK(add_user(branch->lib, "Reader") == SUCCESS);
+  }
+  return branch;
+}
+
+static void build_batch(OperationBatch *batch, const Library *lib) {
+  init_batch(batch);
+  CHECK(batch_borrow(batch, lib->users[0].id, lib->books[0].id) == SUCCESS);
+  CHECK(batch_add_book(batch, "Refactoring", "Martin Fowler",
+                       "Programming") == SUCCESS);
+}
+
+static void test_saved_batch_survives_restart(void) {
+  BranchNetwork net;
+  Branch *branch = open_branch(&net, "saved.txt");
+  OperationBatch batch;
+  build_batch(&batch, branch->lib);
+  int failed_index = 0;
+
+  CHECK(commit_branch_batch(branch, &batch, &failed_index) == SUCCESS);
+  CHECK(failed_index == -1);
+  int book_id = branch->lib->books[0].id;
+  free_branch_network(&net);
+
+  branch = open_branch(&net, "saved.txt");
+  CHECK(branch->lib->book_count == 2);
+  CHECK(find_book_by_id(branch->lib, book_id)->status == BOOK_BORROWED);
+  CHECK(branch->lib->users[0].borrowed_count == 1);
+  free_branch_network(&net);
+}
+
+static void test_failed_operation_changes_nothing(void) {
+  BranchNetwork net;
+  Branch *branch = open_branch(&net, "operation.txt");
+  OperationBatch batch;
+  build_batch(&batch, branch->lib);
+  CHECK(batch_borrow(&batch, branch->lib->users[0].id, 999) == SUCCESS);
+  int failed_index = -1;
+
+  CHECK(commit_branch_batch(branch, &batch, &failed_index) ==
+        ERROR_BOOK_NOT_FOUND);
+  CHECK(failed_index == 2);
+  CHECK(branch->lib->book_count == 1);
+  CHECK(branch->lib->books[0].status == BOOK_AVAILABLE);
+  free_branch_network(&net);
+}
+
+static void test_failed_save_rolls_back(void) {
+  BranchNetwork net;
+  Branch *branch = open_branch(&net, "missing/branch.txt"); /* never exists */
+  Library before = *branch->lib;
+  OperationBatch batch;
+  build_batch(&batch, branch->lib);
+
+  CHECK(commit_branch_batch(branch, &batch, NULL) == ERROR_FILE_IO);
+  CHECK(branch->lib->book_count == before.book_count);
+  CHECK(branch->lib->books[0].status == BOOK_AVAILABLE);
+  CHECK(branch->lib->users[0].borrowed_count == 0);
+  CHECK(branch->lib->next_book_id == before.next_book_id);
+  CHECK(branch->lib->generation == before.generation);
+  free_branch_network(&net);
+}
+
+int main(void) {
+  if (mkdtemp(directory) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  test_saved_batch_survives_restart();
+  test_failed_operation_changes_nothing();
+  test_failed_save_rolls_back();
+
+  char command[MAX_PATH_LENGTH + 16];
+  snprintf(command, sizeof(command), "rm -rf '%s'", directory);
+  if (system(command) != 0) {
+    fprintf(stderr, "Could not remove %s\n", directory);
+  }
+
+  printf("test_batch: %s\n", failures == 0 ? "passed" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
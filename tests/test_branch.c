@@ -0,0 +1,241 @@
+#include "../Utils/utils.h"
+#include "../Book/book.h"
+#include "../Branch/branch.h"
+#include "../Hold/hold.h"
+#include "../Management/management.h"
+#include "../Storage/storage.h"
+#include "../User/user.h"
+
+#include <unistd.h>
+
+/*
+ * Cross-branch transfers: a completed transfer survives a restart, a
+ * failed save leaves both branches as they were, books with patrons
+ * waiting stay put, and a crash between the two saves is finished by
+ * recovery instead of leaving a duplicate. Each branch keeps its ID range
+ * whatever order the branches are opened in. Exits non-zero on the first
+ * failed check.
+ */
+
+static int failures = 0;
+static char directory[] = "/tmp/test_branch_XXXXXX";
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+static void path_in(char *buffer, const char *name) {
+  snprintf(buffer, MAX_PATH_LENGTH, "%s/%s", directory, name);
+}
+
+/* Branches "north" and "south" backed by files in the test directory */
+static void open_network(BranchNetwork *net, const char *south_file) {
+  char journal[MAX_PATH_LENGTH], north[MAX_PATH_LENGTH];
+  path_in(journal, "transfer.journal");
+  path_in(north, "north.txt");
+  init_branch_network(net, journal);
+  CHECK(add_branch(net, "north", 0, north) == SUCCESS);
+  CHECK(add_branch(net, "south", 1, south_file) == SUCCESS);
+}
+
+static bool has_book(BranchNetwork *net, const char *branch, int book_id) {
+  return find_book_by_id(find_branch(net, branch)->lib, book_id) != NULL;
+}
+
+static void test_transfer_survives_restart(void) {
+  char south[MAX_PATH_LENGTH];
+  path_in(south, "south.txt");
+
+  BranchNetwork net;
+  open_network(&net, south);
+  Library *north = find_branch(&net, "north")->lib;
+  CHECK(add_book(north, "Clean Code", "Robert C. Martin", "Programming") ==
+        SUCCESS);
+  int book_id = north->books[0].id;
+  CHECK(save_all_branches(&net) == SUCCESS);
+
+  CHECK(transfer_book(&net, find_branch(&net, "north"),
+                      find_branch(&net, "south"), book_id) == SUCCESS);
+  CHECK(!has_book(&net, "north", book_id));
+  CHECK(has_book(&net, "south", book_id));
+  CHECK(access(net.journal, F_OK) != 0);
+  free_branch_network(&net);
+
+  open_network(&net, south);
+  CHECK(recover_branch_transfer(&net) == SUCCESS);
+  CHECK(!has_book(&net, "north", book_id));
+  CHECK(has_book(&net, "south", book_id));
+  free_branch_network(&net);
+}
+
+static void test_failed_save_rolls_back(void) {
+  char south[MAX_PATH_LENGTH];
+  path_in(south, "missing/south.txt"); /* the directory never exists */
+
+  BranchNetwork net;
+  open_network(&net, south);
+  Library *north = find_branch(&net, "north")->lib;
+  CHECK(add_book(north, "Refactoring", "Martin Fowler", "Programming") ==
+        SUCCESS);
+  int book_id = north->books[north->book_count - 1].id;
+  int north_books = north->book_count;
+
+  CHECK(transfer_book(&net, find_branch(&net, "north"),
+                      find_branch(&net, "south"), book_id) == ERROR_FILE_IO);
+  CHECK(has_book(&net, "north", book_id));
+  CHECK(!has_book(&net, "south", book_id));
+  CHECK(north->book_count == north_books);
+  CHECK(find_branch(&net, "south")->lib->book_count == 0);
+  CHECK(access(net.journal, F_OK) != 0);
+  free_branch_network(&net);
+}
+
+static void test_books_with_holds_stay(void) {
+  char south[MAX_PATH_LENGTH];
+  path_in(south, "south.txt");
+
+  BranchNetwork net;
+  open_network(&net, south);
+  Library *north = find_branch(&net, "north")->lib;
+  CHECK(add_book(north, "Domain-Driven Design", "Eric Evans", "Software") ==
+        SUCCESS);
+  int book_id = north->books[north->book_count - 1].id;
+  CHECK(add_user(north, "Borrower") == SUCCESS);
+  CHECK(add_user(north, "Waiting") == SUCCESS);
+  int borrower = north->users[north->user_count - 2].id;
+  int waiting = north->users[north->user_count - 1].id;
+  CHECK(borrow_book(north, borrower, book_id) == SUCCESS);
+  CHECK(place_hold(north, waiting, book_id) == SUCCESS);
+
+  /* A hold that outlived its loan, as a hand-edited file could have */
+  find_book_by_id(north, book_id)->status = BOOK_AVAILABLE;
+  CHECK(transfer_book(&net, find_branch(&net, "north"),
+                      find_branch(&net, "south"),
+                      book_id) == ERROR_BOOK_HAS_HOLDS);
+  CHECK(has_book(&net, "north", book_id));
+  CHECK(!has_book(&net, "south", book_id));
+  free_branch_network(&net);
+}
+
+/* The state a crash between saving the destination and the source leaves */
+static void test_recovery_finishes_transfer(void) {
+  char south[MAX_PATH_LENGTH];
+  path_in(south, "south.txt");
+
+  BranchNetwork net;
+  open_network(&net, south);
+  Library *north = find_branch(&net, "north")->lib;
+  CHECK(add_book(north, "Working Effectively", "Michael Feathers",
+                 "Programming") == SUCCESS);
+  Book copy = north->books[north->book_count - 1];
+  CHECK(import_book(find_branch(&net, "south")->lib, &copy) == SUCCESS);
+  CHECK(save_all_branches(&net) == SUCCESS);
+
+  AtomicFile file;
+  FILE *stream = atomic_file_begin(&file, net.journal);
+  CHECK(stream != NULL);
+  if (stream != NULL) {
+    fprintf(stream, "TRANSFER %d\nnorth\nsouth\n", copy.id);
+    CHECK(atomic_file_commit(&file, NULL) == SUCCESS);
+  }
+  free_branch_network(&net);
+
+  open_network(&net, south);
+  CHECK(has_book(&net, "north", copy.id));
+  CHECK(recover_branch_transfer(&net) == SUCCESS);
+  CHECK(!has_book(&net, "north", copy.id));
+  CHECK(has_book(&net, "south", copy.id));
+  CHECK(access(net.journal, F_OK) != 0);
+  free_branch_network(&net);
+
+  open_network(&net, south);
+  CHECK(!has_book(&net, "north", copy.id));
+  CHECK(has_book(&net, "south", copy.id));
+  free_branch_network(&net);
+}
+
+/* Reopening the branches in the other order must not move their ID ranges */
+static void test_id_ranges_follow_number(void) {
+  char journal[MAX_PATH_LENGTH], north_file[MAX_PATH_LENGTH],
+      south_file[MAX_PATH_LENGTH];
+  path_in(journal, "ranges.journal");
+  path_in(north_file, "ranges_north.txt");
+  path_in(south_file, "ranges_south.txt");
+
+  BranchNetwork net;
+  init_branch_network(&net, journal);
+  CHECK(add_branch(&net, "north", 0, north_file) == SUCCESS);
+  CHECK(add_branch(&net, "south", 1, south_file) == SUCCESS);
+  Library *north = find_branch(&net, "north")->lib;
+  Library *south = find_branch(&net, "south")->lib;
+  CHECK(add_book(north, "Clean Code", "Robert C. Martin", "Programming") ==
+        SUCCESS);
+  CHECK(add_book(south, "Refactoring", "Martin Fowler", "Programming") ==
+        SUCCESS);
+  int north_id = north->books[0].id;
+  int south_id = south->books[0].id;
+  CHECK(save_all_branches(&net) == SUCCESS);
+  free_branch_network(&net);
+
+  init_branch_network(&net, journal);
+  CHECK(add_branch(&net, "south", 1, south_file) == SUCCESS);
+  CHECK(add_branch(&net, "north", 0, north_file) == SUCCESS);
+  north = find_branch(&net, "north")->lib;
+  south = find_branch(&net, "south")->lib;
+  CHECK(add_book(north, "The Pragmatic Programmer", "Andrew Hunt",
+                 "Programming") == SUCCESS);
+  CHECK(add_book(south, "Test-Driven Development", "Kent Beck",
+                 "Programming") == SUCCESS);
+  int new_north_id = north->books[north->book_count - 1].id;
+  int new_south_id = south->books[south->book_count - 1].id;
+  CHECK(new_north_id == north_id + 1);
+  CHECK(new_south_id == south_id + 1);
+  CHECK(find_branch_for_book(&net, north_id) == find_branch(&net, "north"));
+  CHECK(find_branch_for_book(&net, south_id) == find_branch(&net, "south"));
+  CHECK(find_branch_for_book(&net, new_north_id) ==
+        find_branch(&net, "north"));
+  CHECK(find_branch_for_book(&net, new_south_id) ==
+        find_branch(&net, "south"));
+  CHECK(save_all_branches(&net) == SUCCESS);
+  free_branch_network(&net);
+
+  /* A number already taken, or one the file has issued IDs beyond */
+  init_branch_network(&net, journal);
+  CHECK(add_branch(&net, "north", 0, north_file) == SUCCESS);
+  CHECK(add_branch(&net, "east", 0, south_file) == ERROR_INVALID_INPUT);
+  CHECK(add_branch(&net, "south", MAX_BRANCHES, south_file) ==
+        ERROR_INVALID_INPUT);
+  free_branch_network(&net);
+
+  init_branch_network(&net, journal);
+  CHECK(add_branch(&net, "south", 0, south_file) == ERROR_INVALID_INPUT);
+  CHECK(net.branch_count == 0);
+  free_branch_network(&net);
+}
+
+int main(void) {
+  if (mkdtemp(directory) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  test_transfer_survives_restart();
+  test_failed_save_rolls_back();
+  test_books_with_holds_stay();
+  test_recovery_finishes_transfer();
+  test_id_ranges_follow_number();
+
+  char command[MAX_PATH_LENGTH + 16];
+  snprintf(command, sizeof(command), "rm -rf '%s'", directory);
+  if (system(command) != 0) {
+    fprintf(stderr, "Could not remove %s\n", directory);
+  }
+
+  printf("test_branch: %s\n", failures == 0 ? "passed" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#define _GNU_SOURCE /* F_SETPIPE_SZ */
+#include "../Utils/utils.h"
+#include "../Book/book.h"
+#include "../Hold/hold.h"
+#include "../Management/management.h"
+#include "../Persist/persist.h"
+#include "../Storage/storage.h"
+#include "../User/user.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Background saves: a save that fails while a newer one is already queued
+ * must hand its changed segments to that newer save, and the failure must
+ * still be reported by persist_flush. The failure is injected with a FIFO
+ * in place of the manifest's temp file, since fsync on a pipe fails. The
+ * pipe is shrunk below the manifest's size (Linux F_SETPIPE_SZ) so the
+ * writer stays blocked in the failing save until the test drains it.
+ * Exits non-zero on the first failed check.
+ */
+
+#define TEST_BOOKS (3 * SEGMENT_RECORDS)
+#define TEST_BORROWERS 8 /* MAX_BORROWED_BOOKS loans each */
+#define TEST_HOLDS_PER_BOOK 5
+
+static int failures = 0;
+static char directory[] = "/tmp/test_persist_XXXXXX";
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+/* Enough hold records that the manifest does not fit in one pipe page */
+static void build_library(Library *lib) {
+  char title[MAX_TITLE_LENGTH];
+  init_library(lib);
+  lib->format = FORMAT_SEGMENTED;
+  for (int i = 0; i < TEST_BOOKS; i++) {
+    snprintf(title, sizeof(title), "Original %d", i + 1);
+    CHECK(add_book(lib, title, "Author", "Genre") == SUCCESS);
+  }
+  for (int i = 0; i < MAX_USERS; i++) {
+    CHECK(add_user(lib, "Reader") == SUCCESS);
+  }
+
+  int loans = TEST_BORROWERS * MAX_BORROWED_BOOKS;
+  for (int i = 0; i < loans; i++) {
+    int book_id = lib->books[i].id;
+    CHECK(borrow_book(lib, lib->users[i % TEST_BORROWERS].id, book_id) ==
+          SUCCESS);
+    for (int h = 0; h < TEST_HOLDS_PER_BOOK; h++) {
+      int waiting = TEST_BORROWERS + (i + h) % (MAX_USERS - TEST_BORROWERS);
+      CHECK(place_hold(lib, lib->users[waiting].id, book_id) == SUCCESS);
+    }
+  }
+}
+
+static void drain(int fd) {
+  char buffer[4096];
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  while (read(fd, buffer, sizeof(buffer)) > 0) {
+  }
+  close(fd);
+}
+
+static void test_failed_save_reaches_next_save(void) {
+  char filename[MAX_PATH_LENGTH], fifo[MAX_PATH_LENGTH + 8];
+  snprintf(filename, sizeof(filename), "%s/library.txt", directory);
+  snprintf(fifo, sizeof(fifo), "%s.tmp", filename);
+
+  Library *lib = malloc(sizeof(Library));
+  Library *loaded = malloc(sizeof(Library));
+  CHECK(lib != NULL && loaded != NULL);
+  if (lib == NULL || loaded == NULL) {
+    free(lib);
+    free(loaded);
+    return;
+  }
+  build_library(lib);
+  CHECK(save_library_to_file(lib, filename) == SUCCESS);
+  int first = lib->books[0].id;
+  int second = lib->books[SEGMENT_RECORDS].id;
+
+  CHECK(persist_start(filename) == SUCCESS);
+  CHECK(mkfifo(fifo, 0600) == 0);
+  int fd = open(fifo, O_RDONLY | O_NONBLOCK);
+  CHECK(fd >= 0);
+  CHECK(fcntl(fd, F_SETPIPE_SZ, 4096) >= 0);
+
+  /* A: rewrites the first segment, then stalls writing the manifest */
+  CHECK(update_book(lib, first, "Changed by A", "Author", "Genre") ==
+        SUCCESS);
+  persist_submit(lib);
+  struct pollfd ready = {fd, POLLIN, 0};
+  CHECK(poll(&ready, 1, 5000) == 1);
+
+  /* B: queued while A is running, changes only the second segment */
+  CHECK(update_book(lib, second, "Changed by B", "Author", "Genre") ==
+        SUCCESS);
+  persist_submit(lib);
+  drain(fd);
+
+  CHECK(persist_flush() == ERROR_FILE_IO);
+  CHECK(persist_flush() == SUCCESS);
+  CHECK(persist_stop() == SUCCESS);
+
+  init_library(loaded);
+  CHECK(load_library_from_file(loaded, filename) == SUCCESS);
+  Book *book = find_book_by_id(loaded, first);
+  CHECK(book != NULL && strcmp(book->title, "Changed by A") == 0);
+  book = find_book_by_id(loaded, second);
+  CHECK(book != NULL && strcmp(book->title, "Changed by B") == 0);
+  CHECK(loaded->hold_count == lib->hold_count);
+  free(lib);
+  free(loaded);
+}
+
+int main(void) {
+  if (mkdtemp(directory) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  test_failed_save_reaches_next_save();
+
+  char command[MAX_PATH_LENGTH + 16];
+  snprintf(command, sizeof(command), "rm -rf '%s'", directory);
+  if (system(command) != 0) {
+    fprintf(stderr, "Could not remove %s\n", directory);
+  }
+
+  printf("test_persist: %s\n", failures == 0 ? "passed" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
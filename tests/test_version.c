@@ -0,0 +1,209 @@
+#include "../Utils/utils.h"
+#include "../Book/book.h"
+#include "../Management/management.h"
+#include "../User/user.h"
+#include "../Version/version.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/*
+ * Snapshot isolation: a report running on a read snapshot must see one
+ * version from start to finish while delete_book commits new versions
+ * underneath it. Exits non-zero on the first failed check.
+ */
+
+#define TEST_AVAILABLE_BOOKS 40
+#define TEST_OVERDUE_BOOKS 20
+#define TEST_BORROWERS 4 /* MAX_BORROWED_BOOKS loans each */
+#define TEST_READERS 4
+#define TEST_ROUNDS 2000
+
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,         \
+              #condition);                                                     \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+static void build_library(Library *lib) {
+  char title[MAX_TITLE_LENGTH];
+  init_library(lib);
+  for (int i = 0; i < TEST_AVAILABLE_BOOKS + TEST_OVERDUE_BOOKS; i++) {
+    snprintf(title, sizeof(title), "Book %d", i + 1);
+    add_book(lib, title, "Author", "Genre");
+  }
+  for (int i = 0; i < TEST_BORROWERS; i++) {
+    add_user(lib, "Reader");
+  }
+
+  /* Borrowed a month ago, so every one of them is overdue */
+  time_t long_ago = time(NULL) - 30 * 24 * 60 * 60;
+  for (int i = 0; i < TEST_OVERDUE_BOOKS; i++) {
+    int book_id = TEST_AVAILABLE_BOOKS + i + 1;
+    CHECK(borrow_book_at(lib, 1 + i % TEST_BORROWERS, book_id, long_ago) ==
+          SUCCESS);
+  }
+}
+
+static int count_rows(Library *lib, void (*report)(Library *, RowWriter *)) {
+  char *text = NULL;
+  size_t size = 0;
+  FILE *stream = open_memstream(&text, &size);
+  if (stream == NULL) {
+    return -1;
+  }
+  RowWriter out;
+  row_writer_init_stream(&out, stream, OUTPUT_CSV);
+  report(lib, &out);
+  row_writer_finish(&out);
+  fclose(stream);
+
+  int rows = 0;
+  for (size_t i = 0; i < size; i++) {
+    rows += text[i] == '\n';
+  }
+  free(text);
+  return rows - 1; /* header */
+}
+
+typedef struct {
+  VersionedLibrary *versions;
+  int book_id;
+  ErrorCode result;
+} DeleteJob;
+
+static void *delete_one(void *arg) {
+  DeleteJob *job = arg;
+  Library *next = write_begin(job->versions);
+  job->result = delete_book(next, job->book_id);
+  if (job->result == SUCCESS) {
+    write_commit(job->versions, next);
+  } else {
+    write_abort(job->versions, next);
+  }
+  return NULL;
+}
+
+/* A snapshot taken before a delete still lists the deleted book */
+static void test_delete_after_snapshot(VersionedLibrary *versions) {
+  ReadSnapshot before;
+  CHECK(read_begin(versions, &before) == SUCCESS);
+  Library *old = (Library *)before.lib;
+  int all_books = count_rows(old, report_all_books);
+
+  DeleteJob job = {versions, 7, SUCCESS};
+  pthread_t writer;
+  pthread_create(&writer, NULL, delete_one, &job);
+  pthread_join(writer, NULL);
+  CHECK(job.result == SUCCESS);
+
+  CHECK(find_book_by_id(old, 7) != NULL);
+  CHECK(count_rows(old, report_all_books) == all_books);
+  CHECK(count_rows(old, report_overdue_books) == TEST_OVERDUE_BOOKS);
+  read_end(versions, &before);
+
+  ReadSnapshot after;
+  CHECK(read_begin(versions, &after) == SUCCESS);
+  Library *current = (Library *)after.lib;
+  CHECK(find_book_by_id(current, 7) == NULL);
+  CHECK(count_rows(current, report_all_books) == all_books - 1);
+  read_end(versions, &after);
+}
+
+typedef struct {
+  VersionedLibrary *versions;
+  atomic_bool *stop;
+  int mismatches;
+  int reads;
+} ReaderJob;
+
+/* Each listing is run twice on one snapshot; a moving target shows up as a
+ * different row count or a changed library */
+static void *read_reports(void *arg) {
+  ReaderJob *job = arg;
+  Library *copy = malloc(sizeof(Library));
+  while (copy != NULL && !atomic_load(job->stop)) {
+    ReadSnapshot snapshot;
+    if (read_begin(job->versions, &snapshot) != SUCCESS) {
+      continue;
+    }
+    Library *lib = (Library *)snapshot.lib;
+    memcpy(copy, lib, sizeof(Library));
+
+    int books = count_rows(lib, report_all_books);
+    int overdue = count_rows(lib, report_overdue_books);
+    if (books != lib->book_count || overdue != TEST_OVERDUE_BOOKS ||
+        count_rows(lib, report_all_books) != books ||
+        count_rows(lib, report_overdue_books) != overdue ||
+        memcmp(copy, lib, sizeof(Library)) != 0) {
+      job->mismatches++;
+    }
+    job->reads++;
+    read_end(job->versions, &snapshot);
+  }
+  free(copy);
+  return NULL;
+}
+
+/* Readers list while a writer deletes and re-adds available books */
+static void test_concurrent_deletes(VersionedLibrary *versions) {
+  atomic_bool stop = false;
+  ReaderJob readers[TEST_READERS];
+  pthread_t threads[TEST_READERS];
+  for (int i = 0; i < TEST_READERS; i++) {
+    readers[i] = (ReaderJob){versions, &stop, 0, 0};
+    pthread_create(&threads[i], NULL, read_reports, &readers[i]);
+  }
+
+  int deletes = 0;
+  for (int round = 0; round < TEST_ROUNDS; round++) {
+    Library *next = write_begin(versions);
+    int book_id = 0;
+    for (int i = 0; i < next->book_count && book_id == 0; i++) {
+      if (next->books[i].status == BOOK_AVAILABLE) {
+        book_id = next->books[i].id;
+      }
+    }
+    if (delete_book(next, book_id) == SUCCESS) {
+      deletes++;
+    }
+    add_book(next, "Replacement", "Author", "Genre");
+    write_commit(versions, next);
+  }
+  atomic_store(&stop, true);
+
+  int reads = 0;
+  for (int i = 0; i < TEST_READERS; i++) {
+    pthread_join(threads[i], NULL);
+    CHECK(readers[i].mismatches == 0);
+    reads += readers[i].reads;
+  }
+  CHECK(deletes == TEST_ROUNDS);
+  printf("  %d deletes against %d snapshot reads\n", deletes, reads);
+}
+
+int main(void) {
+  Library *initial = malloc(sizeof(Library));
+  VersionedLibrary versions;
+  if (initial == NULL) {
+    return 1;
+  }
+  build_library(initial);
+  if (init_versioned_library(&versions, initial) != SUCCESS) {
+    free(initial);
+    return 1;
+  }
+  free(initial);
+
+  test_delete_after_snapshot(&versions);
+  test_concurrent_deletes(&versions);
+  free_versioned_library(&versions);
+
+  printf("test_version: %s\n", failures == 0 ? "passed" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}